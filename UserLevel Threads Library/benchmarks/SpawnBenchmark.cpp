@@ -0,0 +1,125 @@
+/*
+ * Measures the cost of creating and ending threads when many of them live at
+ * once, and reports in ns per call:
+ *   fresh spawn      spawning threads up to the limit, every stack mapped anew
+ *   terminate        terminating all of them from the main thread
+ *   pooled spawn     spawning them again from the pool of terminated threads
+ *   churn            a spawn and a terminate of one thread, over and over
+ * The spawned threads block themselves if they ever run, and the quantum is
+ * long enough that they rarely do. The program ends from a spawned thread that
+ * keeps a few KB of locals while it is preempted, so the handler runs under
+ * them on its stack, and that then terminates the main thread, so the library
+ * is torn down from a pooled stack.
+ *
+ * Build from this directory:
+ *   g++ -std=c++17 -O2 -I.. SpawnBenchmark.cpp ../uthreads.cpp -lrt -o spawn
+ * Usage:
+ *   ./spawn [threads] [stack bytes]
+ */
+#include "uthreads.h"
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// threads alive at once when no count is given
+#define DEFAULT_THREADS 100000
+// spawn and terminate pairs of the churn
+#define CHURN_ROUNDS 1000000
+// bytes of locals the last thread keeps while it is preempted
+#define LOCALS_BYTES 4096
+// preemptions of the last thread
+#define PREEMPTIONS 200
+// a quantum of one second of virtual time
+#define QUANTUM_USECS 1000000
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * blocks itself whenever it gets the processor
+ */
+void idle_thread() {
+    while (true)
+        uthread_block(uthread_get_tid());
+}
+
+/**
+ * preempts itself while it keeps a few KB of locals, then ends the program by terminating the main thread
+ */
+void exit_thread() {
+    volatile char locals[LOCALS_BYTES];
+    for (int i = 0; i < LOCALS_BYTES; i++)
+        locals[i] = (char) i;
+    for (int round = 0; round < PREEMPTIONS; round++)
+        raise(SIGVTALRM);
+    for (int i = 0; i < LOCALS_BYTES; i++) {
+        if (locals[i] != (char) i) {
+            fprintf(stderr, "the locals changed while the thread was preempted\n");
+            exit(1);
+        }
+    }
+    uthread_terminate(0);
+}
+
+/**
+ * @return the nanoseconds from start to now divided by count
+ */
+double nanoseconds_per(Clock::time_point start, long long count) {
+    std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+    return elapsed.count() / (double) count;
+}
+
+/**
+ * spawns threads until there are count of them besides main, their ids are written to tids
+ *
+ * @return whether every spawn succeeded
+ */
+bool spawn_threads(std::vector<int>& tids, int count, size_t stack_size) {
+    for (int i = 0; i < count; i++) {
+        tids[i] = uthread_spawn_with_stack(idle_thread, stack_size);
+        if (tids[i] == -1)
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    int threads = argc > 1 ? atoi(argv[1]) : DEFAULT_THREADS;
+    size_t stack_size = argc > 2 ? strtoull(argv[2], nullptr, 10) : STACK_SIZE;
+    if (threads <= 0 || uthread_init_with_limit(QUANTUM_USECS, threads + 1) != 0)
+        return 1;
+    std::vector<int> tids(threads);
+
+    Clock::time_point start = Clock::now();
+    if (!spawn_threads(tids, threads, stack_size))
+        return 1;
+    double fresh = nanoseconds_per(start, threads);
+
+    start = Clock::now();
+    for (int tid : tids)
+        uthread_terminate(tid);
+    double terminate = nanoseconds_per(start, threads);
+
+    start = Clock::now();
+    if (!spawn_threads(tids, threads, stack_size))
+        return 1;
+    double pooled = nanoseconds_per(start, threads);
+    for (int tid : tids)
+        uthread_terminate(tid);
+
+    start = Clock::now();
+    for (int i = 0; i < CHURN_ROUNDS; i++)
+        uthread_terminate(uthread_spawn_with_stack(idle_thread, stack_size));
+    double churn = nanoseconds_per(start, CHURN_ROUNDS);
+
+    printf("%d threads of %zu stack bytes\n", threads, stack_size);
+    printf("%-14s %10.1f ns\n%-14s %10.1f ns\n%-14s %10.1f ns\n%-14s %10.1f ns\n", "fresh spawn", fresh,
+           "terminate", terminate, "pooled spawn", pooled, "churn", churn);
+    fflush(stdout);
+    if (!spawn_threads(tids, threads - 1, stack_size) || uthread_spawn_with_stack(exit_thread, stack_size) == -1)
+        return 1;
+    // the spawned threads run in turn until the last one exits
+    while (true)
+        raise(SIGVTALRM);
+}
@@ -1,42 +1,112 @@
 #include "uthreads.h"
-#include <list>
-#include <map>
-#include <set>
+#include <cstdint>
 #include <iostream>
+#include <new>
 #include <setjmp.h>
 #include <signal.h>
 #include <unistd.h>
-#include <sys/time.h>
-#include <algorithm>
+#include <sys/mman.h>
+#include <time.h>
 
 #define INIT 0
 #define BLOCK 1
 #define SLEEP 2
 #define TERMINATE 3
 #define MICROSECONDS_REFACTOR 1000000
+#define NANOSECONDS_PER_MICROSECOND 1000
+/* stacks are pooled by size class, class k holds stacks of 2^k pages */
+#define POOL_CLASSES 32
+
+/* a guard that takes no mapping of its own, older kernels fall back to mprotect */
+#ifndef MADV_GUARD_INSTALL
+#define MADV_GUARD_INSTALL 102
+#endif
+
+/* with UTHREADS_IDLE_AWARE defined the timer is stopped while no thread but the running one can run, so an idle
+   process gets no SIGVTALRM and no quantum is counted until another thread waits again */
+
+
+void thread_start();
 
 
 #ifdef __x86_64__
 /* code for 64 bit Intel arch */
 
-typedef unsigned long address_t;
-#define JB_SP 6
-#define JB_PC 7
+/**
+ * the context of a thread that isnt running, the callee saved registers and the control words of the floating point
+ * units are pushed on the stack of the thread so only its stack pointer is kept
+ *
+ * @param sp the stack pointer of the thread
+ */
+struct Context {
+    void* sp = nullptr;
+};
 
-/* A translation is required when using an address of a variable.
-   Use this as a black box in your code. */
-address_t translate_address(address_t addr)
-{
-    address_t ret;
-    asm volatile("xor    %%fs:0x30,%0\n"
-                 "rol    $0x11,%0\n"
-            : "=g" (ret)
-            : "0" (addr));
-    return ret;
+#define MXCSR_DEFAULT 0x1F80ULL
+#define FPU_CONTROL_DEFAULT 0x037FULL
+
+/* pushes the callee saved state on the current stack, saves the stack pointer in save_sp, and pops the state of the
+   next thread from load_sp, the signal mask is left untouched */
+extern "C" void uthread_switch_stacks(void** save_sp, void* load_sp);
+
+asm(".text\n"
+    ".globl uthread_switch_stacks\n"
+    ".type uthread_switch_stacks, @function\n"
+    "uthread_switch_stacks:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size uthread_switch_stacks, .-uthread_switch_stacks\n");
+
+/**
+ * save the context of the running thread and continue the next one where it stopped
+ *
+ * @param from the context of the running thread
+ * @param to the context of the next thread
+ */
+inline void switch_context(Context* from, Context* to) {
+    uthread_switch_stacks(&from->sp, to->sp);
+}
+
+/**
+ * build the context of a new thread so that switching to it starts thread_start on its stack, the frame is laid out
+ * as uthread_switch_stacks leaves it, under a return address of thread_start that is never used
+ *
+ * @param context the context of the new thread
+ * @param stack the stack of the new thread
+ * @param size the size of the stack in bytes
+ */
+void init_context(Context* context, char* stack, size_t size) {
+    uint64_t* top = (uint64_t*) (((uintptr_t) stack + size) & ~(uintptr_t) 15);
+    uint64_t* sp = top - 9;
+    sp[0] = MXCSR_DEFAULT | FPU_CONTROL_DEFAULT << 32;
+    for (int i = 1; i <= 6; i++)
+        sp[i] = 0;
+    sp[7] = (uint64_t) &thread_start;
+    sp[8] = 0;
+    context->sp = sp;
 }
 
 #else
-/* code for 32 bit Intel arch */
+/* code for 32 bit Intel arch, the context is a jump buffer that doesnt save the signal mask */
 
 typedef unsigned long address_t;
 #define JB_SP 4
@@ -55,87 +125,285 @@ address_t translate_address(address_t addr)
     return ret;
 }
 
+struct Context {
+    sigjmp_buf env;
+};
+
+inline void switch_context(Context* from, Context* to) {
+    if (sigsetjmp(from->env, 0) == 0)
+        siglongjmp(to->env, 1);
+}
+
+void init_context(Context* context, char* stack, size_t size) {
+    address_t sp = (address_t) stack + size - sizeof(address_t);
+    address_t pc = (address_t) &thread_start;
+    sigsetjmp(context->env, 0);
+    (context->env->__jmpbuf)[JB_SP] = translate_address(sp);
+    (context->env->__jmpbuf)[JB_PC] = translate_address(pc);
+}
+
 
 #endif
+
+class Thread;
+
+/**
+ * the links of a thread inside one queue of threads
+ *
+ * @param prev the thread before it in the queue
+ * @param next the thread after it in the queue
+ * @param queued whether the thread is in the queue
+ */
+struct ThreadLink {
+    Thread* prev = nullptr;
+    Thread* next = nullptr;
+    bool queued = false;
+};
+
 /**
  * a Class for the object thread
  *
- * Detailed description of the function, which can span multiple lines.
+ * A thread is in at most one of the ready, blocked and terminated queues and the pool through queue_link, and may be
+ * in the sleeping heap at the same time, so a thread can sleep while blocked. A thread in the pool keeps its stack
+ * for the next spawn of its size class.
  *
- * @param remaining_sleeping_time remaining sleeping time in quantums of the thread if <= 0 the the thread isnt sleeping
+ * @param wake_quantum the total number of quantums at which the thread wakes up if it is sleeping
+ * @param sleep_index the position of the thread in the sleeping heap, -1 if the thread isnt sleeping
  * @param current_quantum_usec the number of quantum the thread has ran for so far
  * @param tid the id of the thread
- * @param stack the stack of the thread
- * @param env the environment of the thread
+ * @param blocked whether the thread was blocked and not resumed yet
+ * @param stack the lowest address of the stack of the thread, a guard page lies right under it
+ * @param stack_size the size of the stack in bytes, the size of its class in the pool
+ * @param entry_point the function the thread runs
+ * @param context the saved context of the thread while it isnt running
+ * @param queue_link the links of the thread in the ready, blocked or terminated queue or in the pool
  */
 class Thread {
 
 public:
-    int remaining_sleeping_time;
-    int current_quantum_usec;
-    int tid;
-    char* stack;
-    sigjmp_buf env;
+    long long wake_quantum = 0;
+    int sleep_index = -1;
+    int current_quantum_usec = 0;
+    int tid = 0;
+    bool blocked = false;
+    char* stack = nullptr;
+    size_t stack_size = 0;
+    thread_entry_point entry_point = nullptr;
+    Context context;
+    ThreadLink queue_link;
+};
 
-    Thread() = default;
+/**
+ * an intrusive doubly linked queue of threads, the links live inside the threads so every operation is O(1) and
+ * never allocates
+ *
+ * @param link the member of Thread holding the links of the queue
+ */
+template <ThreadLink Thread::*link>
+class ThreadQueue {
 
-    Thread (int tid, thread_entry_point entry_point) {
-        this->tid = tid;
-        this->current_quantum_usec = 0;
-        this->remaining_sleeping_time = 0;
-        this->stack = new char[STACK_SIZE];
-        address_t sp = (address_t) stack + STACK_SIZE - sizeof(address_t);
-        address_t pc = (address_t) entry_point;
-        sigsetjmp(env, 1);
-        (env->__jmpbuf)[JB_SP] = translate_address(sp);
-        (env->__jmpbuf)[JB_PC] = translate_address(pc);
-        sigemptyset(&env->__saved_mask);
+public:
+    bool empty() const {
+        return head == nullptr;
     }
+
+    Thread* front() const {
+        return head;
+    }
+
+    static bool contains(const Thread* thread) {
+        return (thread->*link).queued;
+    }
+
+    void push_back(Thread* thread) {
+        ThreadLink& links = thread->*link;
+        links.prev = tail;
+        links.next = nullptr;
+        links.queued = true;
+        if (tail != nullptr)
+            (tail->*link).next = thread;
+        else
+            head = thread;
+        tail = thread;
+    }
+
+    Thread* pop_front() {
+        Thread* thread = head;
+        remove(thread);
+        return thread;
+    }
+
+    void remove(Thread* thread) {
+        ThreadLink& links = thread->*link;
+        if (links.prev != nullptr)
+            (links.prev->*link).next = links.next;
+        else
+            head = links.next;
+        if (links.next != nullptr)
+            (links.next->*link).prev = links.prev;
+        else
+            tail = links.prev;
+        links.prev = nullptr;
+        links.next = nullptr;
+        links.queued = false;
+    }
+
+private:
+    Thread* head = nullptr;
+    Thread* tail = nullptr;
 };
+
+/**
+ * a binary min heap of the sleeping threads keyed by the quantum they wake up at, every thread knows its position so
+ * it can be removed in O(log n), and the heap allocates room for every thread once
+ */
+class SleepHeap {
+
+public:
+    void allocate(int capacity) {
+        heap = new Thread*[capacity];
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    Thread* top() const {
+        return heap[0];
+    }
+
+    static bool contains(const Thread* thread) {
+        return thread->sleep_index != -1;
+    }
+
+    void push(Thread* thread) {
+        heap[count] = thread;
+        thread->sleep_index = count;
+        count++;
+        sift_up(thread->sleep_index);
+    }
+
+    void remove(Thread* thread) {
+        int index = thread->sleep_index;
+        thread->sleep_index = -1;
+        count--;
+        if (index == count)
+            return;
+        place(heap[count], index);
+        sift_up(index);
+        sift_down(heap[index]->sleep_index);
+    }
+
+private:
+    Thread** heap = nullptr;
+    int count = 0;
+
+    void place(Thread* thread, int index) {
+        heap[index] = thread;
+        thread->sleep_index = index;
+    }
+
+    void sift_up(int index) {
+        Thread* thread = heap[index];
+        while (index > 0 && heap[(index - 1) / 2]->wake_quantum > thread->wake_quantum) {
+            place(heap[(index - 1) / 2], index);
+            index = (index - 1) / 2;
+        }
+        place(thread, index);
+    }
+
+    void sift_down(int index) {
+        Thread* thread = heap[index];
+        while (2 * index + 1 < count) {
+            int child = 2 * index + 1;
+            if (child + 1 < count && heap[child + 1]->wake_quantum < heap[child]->wake_quantum)
+                child++;
+            if (heap[child]->wake_quantum >= thread->wake_quantum)
+                break;
+            place(heap[child], index);
+            index = child;
+        }
+        place(thread, index);
+    }
+};
+
 /**
  * Global variables for the library
  * @param running_thread a pointer to the current running thread
  * @param passed_quantum_usec How many quantums passed since the library was initialized
  * @param quantum_value_usecs length of quantum in microseconds
- * @param ready_threads a list of the ready threads 
- * @param sleeping_threads a set of the sleeping threads
- * @param tid_to_threads a map of the id of threads as keys and the thread themselfs as values
- * @param available_threads a set of all the integer that are free to give as id for a thread
- * @param blocked_threads a set of all the blocked threads presented as their ids
- * @param timer itimerval to manage the quantums
- * @param sa a sigaction object 
+ * @param ready_threads a queue of the ready threads
+ * @param sleeping_threads a heap of the sleeping threads, the next to wake up on top
+ * @param blocked_threads a queue of the blocked threads
+ * @param terminated_threads threads that terminated themselves, moved to the pool by the next spawn
+ * @param thread_pool the threads that terminated with their stacks, a queue for every size class
+ * @param max_threads the maximal number of threads, ids run from 0 to max_threads - 1
+ * @param page_size the size of a page, stacks and their guards are made of whole pages
+ * @param tid_to_threads the thread of every id, nullptr for ids that are free
+ * @param available_threads a bitmap of the ids that are free to give to a thread
+ * @param available_words a bitmap of the words of available_threads that have a free id
+ * @param quantum_timer the timer that sends SIGVTALRM every quantum of cpu time of the process
+ * @param timer_armed whether the timer is running
  * @param sig_set a sig_set object
  */
 Thread* running_thread;
 int passed_quantum_usec;
 int quantum_value_usecs;
-std::list<Thread*> ready_threads;
-std::set<Thread*> sleeping_threads;
-std::map<int, Thread*> tid_to_threads;
-std::set<int> available_threads;
-std::set<int> blocked_threads;
-struct itimerval timer;
-struct sigaction sa;
+ThreadQueue<&Thread::queue_link> ready_threads;
+SleepHeap sleeping_threads;
+ThreadQueue<&Thread::queue_link> blocked_threads;
+ThreadQueue<&Thread::queue_link> terminated_threads;
+ThreadQueue<&Thread::queue_link> thread_pool[POOL_CLASSES];
+int max_threads;
+size_t page_size;
+Thread** tid_to_threads = nullptr;
+uint64_t* available_threads;
+uint64_t* available_words;
+timer_t quantum_timer;
+bool timer_armed = false;
 sigset_t sig_set;
 
 
 void round_robin_handler(int);
 
 
-void reduce_sleeping_time();
+void wake_sleeping_threads();
 
 int get_min_id_available();
 
-void handle_switch_threads();
+void handle_switch_threads(bool);
 
 void terminate_thread(int);
 /**
- * realese all allocated memory of all the threads
+ * realese the memory of a thread, a stack the caller still runs on is left mapped, the program exits right after it
+ * releases the threads so only the exiting process frees it
+ *
+ * @param thread the thread
+ */
+void delete_thread(Thread* thread) {
+    uintptr_t frame = (uintptr_t) __builtin_frame_address(0);
+    uintptr_t mapping = (uintptr_t) thread->stack - page_size;
+    if (thread->stack != nullptr && (frame < mapping || frame >= mapping + thread->stack_size + page_size))
+        munmap((void*) mapping, thread->stack_size + page_size);
+    delete thread;
+}
+
+/**
+ * realese all allocated memory of all the threads, called on the way to exit from whichever thread runs
  */
 void delete_threads() {
-    for (auto curr : tid_to_threads) {
-        delete curr.second->stack;
-        delete curr.second;
+    if (tid_to_threads != nullptr) {
+        for (int tid = 0; tid < max_threads; tid++) {
+            if (tid_to_threads[tid] != nullptr)
+                delete_thread(tid_to_threads[tid]);
+            tid_to_threads[tid] = nullptr;
+        }
+    }
+    while (!terminated_threads.empty())
+        delete_thread(terminated_threads.pop_front());
+    for (ThreadQueue<&Thread::queue_link>& pool : thread_pool) {
+        while (!pool.empty())
+            delete_thread(pool.pop_front());
     }
 }
 
@@ -153,56 +421,226 @@ void handle_block_unblock(int action) {
 }
 
 /**
- * function initialize available_set by inserting all integers from 1 to  MAX_THREAD_NUM to it
+ * function out put the size class of a stack, the stacks of class k have 2^k pages
+ *
+ * @param stack_size the size of the stack in bytes
+ * @return the class, or -1 if the stack is larger than the largest class
+ */
+int stack_class(size_t stack_size) {
+    size_t pages = (stack_size + page_size - 1) / page_size;
+    if (pages > 1ULL << (POOL_CLASSES - 1))
+        return -1;
+    return pages <= 1 ? 0 : 64 - __builtin_clzll(pages - 1);
+}
+
+/**
+ * function put a thread that wont run again in the pool of its size class
+ *
+ * @param thread the thread
  */
-void initialize_available_set() {
-    for(int i = 1; i < MAX_THREAD_NUM; i++) {
-        available_threads.insert(i);
+void pool_thread(Thread* thread) {
+    thread_pool[stack_class(thread->stack_size)].push_back(thread);
+}
+
+/**
+ * function move the threads that terminated themselves to the pool, they are no longer on the processor once another
+ * thread spawns
+ */
+void pool_terminated_threads() {
+    while (!terminated_threads.empty())
+        pool_thread(terminated_threads.pop_front());
+}
+
+/**
+ * function allocate a thread and a stack of a size class with a guard page under it, so running past the stack
+ * faults instead of writing over other memory, if fail terminate the program
+ *
+ * @param pool_class the size class of the stack
+ * @return the thread
+ */
+Thread* allocate_thread(int pool_class) {
+    Thread* thread;
+    try {
+        thread = new Thread();
     }
+    catch (std::bad_alloc&) {
+        std::cerr << "system error: thread couldn't be created\n";
+        delete_threads();
+        exit(1);
+    }
+    size_t stack_size = page_size << pool_class;
+    void* mapping = mmap(nullptr, stack_size + page_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "system error: mmap has failed\n";
+        delete thread;
+        delete_threads();
+        exit(1);
+    }
+    if (madvise(mapping, page_size, MADV_GUARD_INSTALL) == -1 && mprotect(mapping, page_size, PROT_NONE) == -1) {
+        std::cerr << "system error: mprotect has failed\n";
+        munmap(mapping, stack_size + page_size);
+        delete thread;
+        delete_threads();
+        exit(1);
+    }
+    thread->stack = (char*) mapping + page_size;
+    thread->stack_size = stack_size;
+    return thread;
 }
+
 /**
- * function set the timer and put its handler as round robin if fail in any part of the function terminate the program
+ * the first function every spawned thread runs, the switch to the thread ran with SIGVTALRM masked so it is unmasked
+ * before the entry point is called, a thread whose entry point returns terminates itself
+ */
+void thread_start() {
+    handle_block_unblock(SIG_UNBLOCK);
+    running_thread->entry_point();
+    uthread_terminate(running_thread->tid);
+}
+
+/**
+ * function marks an id as free to give to a new thread
  *
- * @param action an integer of SIG_UNBLOCK SIG_BLOCK values
+ * @param tid the id
  */
-void set_timer() {
+void release_id(int tid) {
+    available_threads[tid / 64] |= 1ULL << (tid % 64);
+    available_words[tid / 4096] |= 1ULL << (tid / 64 % 64);
+}
+
+/**
+ * function marks an id as given to a thread
+ *
+ * @param tid the id
+ */
+void take_id(int tid) {
+    available_threads[tid / 64] &= ~(1ULL << (tid % 64));
+    if (available_threads[tid / 64] == 0)
+        available_words[tid / 4096] &= ~(1ULL << (tid / 64 % 64));
+}
+
+/**
+ * function allocate the tables of the threads for max_threads ids and mark the ids from 1 to max_threads - 1 as free,
+ * if fail terminate the program
+ */
+void initialize_tables() {
+    int id_words = (max_threads + 63) / 64;
+    try {
+        tid_to_threads = new Thread*[max_threads]();
+        available_threads = new uint64_t[id_words]();
+        available_words = new uint64_t[(id_words + 63) / 64]();
+        sleeping_threads.allocate(max_threads);
+    }
+    catch (std::bad_alloc&) {
+        std::cerr << "system error: the thread tables couldn't be allocated\n";
+        exit(1);
+    }
+    for (int tid = 1; tid < max_threads; tid++)
+        release_id(tid);
+}
+/**
+ * function install round robin as the handler of SIGVTALRM and create the timer of the quantums, a timer on the cpu
+ * time of the process like the virtual timer, if fail in any part of the function terminate the program
+ */
+void create_timer() {
+    struct sigaction sa = {};
     sa.sa_handler = &round_robin_handler;
     if (sigaction(SIGVTALRM, &sa, NULL) == -1) {
         std::cerr << "system error: sigaction has failed\n";
-        uthread_terminate(0);
+        delete_threads();
+        exit(1);
+    }
+    struct sigevent event = {};
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = SIGVTALRM;
+    if (timer_create(CLOCK_PROCESS_CPUTIME_ID, &event, &quantum_timer) == -1) {
+        std::cerr << "system error: timer_create has failed\n";
+        delete_threads();
         exit(1);
     }
-    timer.it_interval.tv_sec = quantum_value_usecs / MICROSECONDS_REFACTOR;
-    timer.it_interval.tv_usec = quantum_value_usecs % MICROSECONDS_REFACTOR;
-    timer.it_value.tv_sec = quantum_value_usecs / MICROSECONDS_REFACTOR;
-    timer.it_value.tv_usec = quantum_value_usecs % MICROSECONDS_REFACTOR;
-    if (setitimer(ITIMER_VIRTUAL, &timer, NULL)) {
-        std::cerr << "system error: setitimer has failed\n";
-        uthread_terminate(0);
+}
+
+/**
+ * function start a full quantum for the running thread or stop the timer, a started timer keeps firing every quantum
+ * so a preemption never has to rearm it, if fail terminate the program
+ *
+ * @param armed whether to start the timer or to stop it
+ */
+void set_timer(bool armed) {
+    struct itimerspec timer = {};
+    if (armed) {
+        timer.it_value.tv_sec = quantum_value_usecs / MICROSECONDS_REFACTOR;
+        timer.it_value.tv_nsec = quantum_value_usecs % MICROSECONDS_REFACTOR * NANOSECONDS_PER_MICROSECOND;
+        timer.it_interval = timer.it_value;
+    }
+    if (timer_settime(quantum_timer, 0, &timer, NULL) == -1) {
+        std::cerr << "system error: timer_settime has failed\n";
+        delete_threads();
         exit(1);
     }
+    timer_armed = armed;
+}
+
+/**
+ * @return whether a thread other than the running one waits to run, now or once it wakes up
+ */
+bool threads_waiting() {
+    return !ready_threads.empty() || !sleeping_threads.empty();
+}
+
+/**
+ * function start a new quantum for the running thread, in idle aware mode the timer is stopped instead while no other
+ * thread waits
+ */
+void restart_quantum() {
+#ifdef UTHREADS_IDLE_AWARE
+    if (!threads_waiting()) {
+        if (timer_armed)
+            set_timer(false);
+        return;
+    }
+#endif
+    set_timer(true);
 }
+
 /**
- * function out put the minimal id that doesnt represents a thread
+ * function start the timer if it was stopped while the running thread was alone, called when a thread becomes ready
+ */
+void wake_timer() {
+    if (!timer_armed)
+        set_timer(true);
+}
+/**
+ * function out put the minimal id that doesnt represents a thread, the first set bit of available_words leads to the
+ * first word of available_threads with a free id
  *
  * @return an integer represents the id
  */
 int get_min_id_available() {
-    if (available_threads.empty())
-        return -1;
-    int min_id = MAX_THREAD_NUM;
-    for (int id : available_threads) {
-        if (id < min_id)
-            min_id = id;
+    int summary_words = ((max_threads + 63) / 64 + 63) / 64;
+    for (int summary = 0; summary < summary_words; summary++) {
+        if (available_words[summary] != 0) {
+            int word = summary * 64 + __builtin_ctzll(available_words[summary]);
+            return word * 64 + __builtin_ctzll(available_threads[word]);
+        }
     }
-    return min_id;
+    return -1;
 }
 
 int uthread_init(int quantum_usecs) {
+    return uthread_init_with_limit(quantum_usecs, MAX_THREAD_NUM);
+}
+
+int uthread_init_with_limit(int quantum_usecs, int max_thread_num) {
     if (quantum_usecs <= 0) {
         std::cerr << "thread library error: quantum usecs must have a positive value\n";
         return -1;
     }
+    if (max_thread_num <= 0) {
+        std::cerr << "thread library error: the maximal number of threads must have a positive value\n";
+        return -1;
+    }
     if (sigemptyset(&sig_set) == -1) {
         std::cerr << "system error: sigemptyset has failed\n";
         delete_threads();
@@ -215,41 +653,67 @@ int uthread_init(int quantum_usecs) {
     }
     passed_quantum_usec = 0;
     quantum_value_usecs = quantum_usecs;
-    initialize_available_set();
-    available_threads.erase(0);
+    max_threads = max_thread_num;
+    page_size = sysconf(_SC_PAGESIZE);
+    initialize_tables();
     auto t = new Thread();
     tid_to_threads[0] = t;
     running_thread = t;
+    create_timer();
     round_robin_handler(INIT);
-    set_timer();
+    restart_quantum();
     return 0;
 }
 
 int uthread_spawn(thread_entry_point entry_point) {
-    handle_block_unblock(SIG_BLOCK);
+    return uthread_spawn_with_stack(entry_point, STACK_SIZE);
+}
+
+int uthread_spawn_with_stack(thread_entry_point entry_point, size_t stack_size) {
     if (entry_point == nullptr) {
         std::cerr << "thread library error: entry_point cannot be null\n";
-        handle_block_unblock(SIG_UNBLOCK);
         return -1;
     }
-    int id = get_min_id_available();
-    if (id == -1) {
+    int pool_class = stack_size == 0 ? -1 : stack_class(stack_size);
+    if (pool_class == -1) {
+        std::cerr << "thread library error: stack size is out of range\n";
+        return -1;
+    }
+    handle_block_unblock(SIG_BLOCK);
+    if (get_min_id_available() == -1) {
         std::cerr << "thread library error: there aren't available threads\n";
         handle_block_unblock(SIG_UNBLOCK);
         return -1;
     }
-    try {
-        auto new_thread = new Thread(id, entry_point);
-        ready_threads.push_back(new_thread);
-        tid_to_threads[id] = new_thread;
-        available_threads.erase(id);
+    pool_terminated_threads();
+    Thread* new_thread;
+    if (!thread_pool[pool_class].empty()) {
+        new_thread = thread_pool[pool_class].pop_front();
     }
-    catch (std::bad_alloc&) {
-        std::cerr << "system error: thread couldn't be created\n";
-        uthread_terminate(0);
+    else {
+        // a new thread and its stack are allocated with the signals unmasked, before an id is taken, so a spawning
+        // thread that is terminated meanwhile only leaves the new thread unlinked
         handle_block_unblock(SIG_UNBLOCK);
-        exit(1);
+        new_thread = allocate_thread(pool_class);
+        handle_block_unblock(SIG_BLOCK);
     }
+    // other threads may have taken the free ids while the signals were unmasked
+    int id = get_min_id_available();
+    if (id == -1) {
+        std::cerr << "thread library error: there aren't available threads\n";
+        pool_thread(new_thread);
+        handle_block_unblock(SIG_UNBLOCK);
+        return -1;
+    }
+    take_id(id);
+    new_thread->tid = id;
+    new_thread->blocked = false;
+    new_thread->current_quantum_usec = 0;
+    new_thread->entry_point = entry_point;
+    init_context(&new_thread->context, new_thread->stack, new_thread->stack_size);
+    tid_to_threads[id] = new_thread;
+    ready_threads.push_back(new_thread);
+    wake_timer();
     handle_block_unblock(SIG_UNBLOCK);
     return id;
 }
@@ -257,55 +721,52 @@ int uthread_spawn(thread_entry_point entry_point) {
 /**
  * Implementation of round robin scheduler that switch from the running thread to the next thread depends on the action
  *
+ * Every switch runs with SIGVTALRM masked, by the api call or by the kernel while the handler runs, so the mask is
+ * not saved with the context. A thread that switched out unmasks it once when it returns from the api call or the
+ * handler, and a new thread unmasks it in thread_start.
+ *
  * @param action an int {SLEEP, BLOCK, TERMINATE} or else that represents the reason for the switch (else for quantum over)
  */
 void round_robin_handler(int action) {
-    int res = sigsetjmp(running_thread->env, 1);
-    if (res == 0) {
-        if (action == SLEEP) {
-            sleeping_threads.insert(running_thread);
-            handle_switch_threads();
-        }
-        else if (action == BLOCK) {
-            handle_switch_threads();
-        }
-        else if (action == TERMINATE) {
-            delete running_thread->stack;
-            delete running_thread;
-            handle_switch_threads();
+    if (action == SLEEP) {
+        sleeping_threads.push(running_thread);
+        handle_switch_threads(true);
+    }
+    else if (action == BLOCK) {
+        handle_switch_threads(true);
+    }
+    else if (action == TERMINATE) {
+        // the thread still runs on its stack, it is released after the switch
+        terminated_threads.push_back(running_thread);
+        handle_switch_threads(true);
+    }
+    else {
+        if (!ready_threads.empty()) {
+            // the timer already started the quantum of the next thread
+            ready_threads.push_back(running_thread);
+            handle_switch_threads(false);
         }
         else {
-            if (!ready_threads.empty()) {
-                ready_threads.push_back(running_thread);
-                handle_switch_threads();
-            }
-            else {
-                running_thread->current_quantum_usec++;
-                passed_quantum_usec++;
-                reduce_sleeping_time();
-            }
+            running_thread->current_quantum_usec++;
+            passed_quantum_usec++;
+            wake_sleeping_threads();
+#ifdef UTHREADS_IDLE_AWARE
+            if (timer_armed && !threads_waiting())
+                set_timer(false);
+#endif
         }
     }
 }
 /**
- * Reduce the sleeping time of all sleeping thread by one and wake every thread that reach 0   if thread unblock also put it in ready threads
+ * Wake every sleeping thread whose wake up quantum has started, only the threads that wake up are touched  if thread
+ * unblock also put it in ready threads
  */
-void reduce_sleeping_time() {
-    if (sleeping_threads.empty())
-        return;
-    auto thread = sleeping_threads.begin();
-    while (thread != sleeping_threads.end()) {
-        (*thread)->remaining_sleeping_time--;
-        if ((*thread)->remaining_sleeping_time == 0) {
-            auto temp = (*thread);
-            thread++;
-            if(blocked_threads.find(temp->tid) == blocked_threads.end())
-                ready_threads.push_back(temp);
-            sleeping_threads.erase(temp);
-        }
-        else {
-            thread++;
-        }
+void wake_sleeping_threads() {
+    while (!sleeping_threads.empty() && sleeping_threads.top()->wake_quantum <= passed_quantum_usec) {
+        Thread* thread = sleeping_threads.top();
+        sleeping_threads.remove(thread);
+        if (!thread->blocked)
+            ready_threads.push_back(thread);
     }
 }
 
@@ -320,7 +781,8 @@ int uthread_sleep(int num_quantums) {
         handle_block_unblock(SIG_UNBLOCK);
         return -1;
     }
-    running_thread->remaining_sleeping_time = num_quantums;
+    // the quantum that starts when the thread goes to sleep is the first one counted
+    running_thread->wake_quantum = (long long) passed_quantum_usec + num_quantums;
     round_robin_handler(SLEEP);
     handle_block_unblock(SIG_UNBLOCK);
     return 0;
@@ -328,12 +790,12 @@ int uthread_sleep(int num_quantums) {
 
 int uthread_terminate(int tid) {
     handle_block_unblock(SIG_BLOCK);
-    if (tid < 0 || tid >= MAX_THREAD_NUM) {
+    if (tid < 0 || tid >= max_threads) {
         std::cerr << "thread library error: tid is not in the valid range\n";
         handle_block_unblock(SIG_UNBLOCK);
         return -1;
     }
-    if (tid_to_threads.find(tid) == tid_to_threads.end()) {
+    if (tid_to_threads[tid] == nullptr) {
         std::cerr << "thread library error: there isn't a thread with this tid\n";
         handle_block_unblock(SIG_UNBLOCK);
         return -1;
@@ -345,49 +807,54 @@ int uthread_terminate(int tid) {
     }
     if (running_thread->tid != tid) {
         terminate_thread(tid);
+        handle_block_unblock(SIG_UNBLOCK);
+        return 0;
     }
-    else {
-        available_threads.insert(tid);
-        tid_to_threads.erase(tid);
-        round_robin_handler(TERMINATE);
-    }
+    release_id(tid);
+    tid_to_threads[tid] = nullptr;
+    round_robin_handler(TERMINATE);
     handle_block_unblock(SIG_UNBLOCK);
     return 0;
 }
 
 /**
- * get an id of a thread and realese all allocated memory and remove him from all global variables
+ * get an id of a thread and remove him from all global variables, the thread goes to the pool
  *
  * @param tid the id of the thread we terminate
  */
 void terminate_thread(int tid) {
     // A function that gets a tid of a thread (not the running thread) and terminates it.
-    auto thread = tid_to_threads[tid];
-    available_threads.insert(tid);
-    blocked_threads.erase(tid);
-    tid_to_threads.erase(tid);
-    sleeping_threads.erase(thread);
-    ready_threads.remove(thread);
-    delete thread->stack;
-    delete thread;
+    Thread* thread = tid_to_threads[tid];
+    release_id(tid);
+    tid_to_threads[tid] = nullptr;
+    if (thread->blocked)
+        blocked_threads.remove(thread);
+    else if (ready_threads.contains(thread))
+        ready_threads.remove(thread);
+    if (sleeping_threads.contains(thread))
+        sleeping_threads.remove(thread);
+    pool_thread(thread);
 }
 /**
  * a helper function for round robin  for the switch to the next thread in line
+ *
+ * @param restart_timer whether the next thread needs a new quantum from the timer, false when the quantum is over
  */
-void handle_switch_threads() {
-    running_thread = ready_threads.front();
+void handle_switch_threads(bool restart_timer) {
+    Thread* previous = running_thread;
+    running_thread = ready_threads.pop_front();
     running_thread->current_quantum_usec++;
     passed_quantum_usec++;
-    ready_threads.pop_front();
-    reduce_sleeping_time();
-    set_timer();
-    siglongjmp(running_thread->env, 1);
+    wake_sleeping_threads();
+    if (restart_timer)
+        restart_quantum();
+    switch_context(&previous->context, &running_thread->context);
 }
 
 
 int uthread_block(int tid) {
     handle_block_unblock(SIG_BLOCK);
-    if (tid < 0 || tid >= MAX_THREAD_NUM) {
+    if (tid < 0 || tid >= max_threads) {
         std::cerr << "thread library error: tid is not in the valid range\n";
         handle_block_unblock(SIG_UNBLOCK);
         return -1;
@@ -397,17 +864,21 @@ int uthread_block(int tid) {
         handle_block_unblock(SIG_UNBLOCK);
         return -1;
     }
-    if (tid_to_threads.find(tid) == tid_to_threads.end()) {
+    Thread* thread = tid_to_threads[tid];
+    if (thread == nullptr) {
         std::cerr << "thread library error: there isn't a thread with this tid\n";
         handle_block_unblock(SIG_UNBLOCK);
         return -1;
     }
-    if (running_thread->tid != tid) {
-        blocked_threads.insert(tid);
-        ready_threads.remove(tid_to_threads[tid]);
+    if (thread->blocked) {
+        handle_block_unblock(SIG_UNBLOCK);
+        return 0;
     }
-    else {
-        blocked_threads.insert(tid);
+    thread->blocked = true;
+    if (ready_threads.contains(thread))
+        ready_threads.remove(thread);
+    blocked_threads.push_back(thread);
+    if (running_thread == thread) {
         round_robin_handler(BLOCK);
     }
     handle_block_unblock(SIG_UNBLOCK);
@@ -417,21 +888,25 @@ int uthread_block(int tid) {
 
 int uthread_resume(int tid) {
     handle_block_unblock(SIG_BLOCK);
-    if (tid < 0 || tid >= MAX_THREAD_NUM) {
+    if (tid < 0 || tid >= max_threads) {
         std::cerr << "thread library error: tid is not in the valid range\n";
         handle_block_unblock(SIG_UNBLOCK);
         return -1;
     }
-    if (tid_to_threads.find(tid) == tid_to_threads.end()) {
+    Thread* thread = tid_to_threads[tid];
+    if (thread == nullptr) {
         std::cerr << "thread library error: there isn't a thread with this tid\n";
         handle_block_unblock(SIG_UNBLOCK);
         return -1;
     }
-    blocked_threads.erase(tid);
-    if(sleeping_threads.find(tid_to_threads[tid]) == sleeping_threads.end() &&
-       std::find(ready_threads.begin(), ready_threads.end(),
-                 tid_to_threads.at(tid)) == ready_threads.end()) {
-        ready_threads.push_back(tid_to_threads[tid]);
+    if (thread->blocked) {
+        thread->blocked = false;
+        blocked_threads.remove(thread);
+        // a sleeping thread goes to the ready queue when it wakes up
+        if (!sleeping_threads.contains(thread)) {
+            ready_threads.push_back(thread);
+            wake_timer();
+        }
     }
     handle_block_unblock(SIG_UNBLOCK);
     return 0;
@@ -448,11 +923,11 @@ int uthread_get_total_quantums() {
 }
 
 int uthread_get_quantums(int tid) {
-    if (tid < 0 || tid >= MAX_THREAD_NUM) {
+    if (tid < 0 || tid >= max_threads) {
         std::cerr << "thread library error: tid is not in the valid range\n";
         return -1;
     }
-    if (available_threads.find(tid) != available_threads.end()) {
+    if (tid_to_threads[tid] == nullptr) {
         std::cerr << "thread library error: the thread with the current tid doesn't exist\n";
         return -1;
     }
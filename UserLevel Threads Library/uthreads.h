@@ -3,8 +3,10 @@
 #define _UTHREADS_H
 
 
-#define MAX_THREAD_NUM 100 /* maximal number of threads */
-#define STACK_SIZE 4096 /* stack size per thread (in bytes) */
+#include <stddef.h>
+
+#define MAX_THREAD_NUM 100 /* maximal number of threads of uthread_init */
+#define STACK_SIZE 65536 /* stack size per thread of uthread_spawn (in bytes) */
 
 typedef void (*thread_entry_point)(void);
 
@@ -25,20 +27,44 @@ typedef void (*thread_entry_point)(void);
 */
 int uthread_init(int quantum_usecs);
 
+/**
+ * @brief initializes the thread library like uthread_init, with a limit of max_thread_num concurrent threads
+ * instead of MAX_THREAD_NUM.
+ *
+ * The thread ids run from 0 to max_thread_num - 1.
+ * It is an error to call this function with non-positive quantum_usecs or max_thread_num.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_init_with_limit(int quantum_usecs, int max_thread_num);
+
 /**
  * @brief Creates a new thread, whose entry point is the function entry_point with the signature
  * void entry_point(void).
  *
  * The thread is added to the end of the READY threads list.
  * The uthread_spawn function should fail if it would cause the number of concurrent threads to exceed the
- * limit (MAX_THREAD_NUM).
- * Each thread should be allocated with a stack of size STACK_SIZE bytes.
+ * limit (MAX_THREAD_NUM, or the limit given to uthread_init_with_limit).
+ * Each thread should be allocated with a stack of size STACK_SIZE bytes, 64 KB, which leaves room for the frame of
+ * the SIGVTALRM handler that preempts the thread on its own stack, as large as several KB on processors with wide
+ * vector registers. Only the pages a thread touches take memory.
  * It is an error to call this function with a null entry_point.
  *
  * @return On success, return the ID of the created thread. On failure, return -1.
 */
 int uthread_spawn(thread_entry_point entry_point);
 
+/**
+ * @brief Creates a new thread like uthread_spawn, with a stack of at least stack_size bytes.
+ *
+ * The stack is rounded up to a power of two pages and has a guard page under it, so a thread that overflows its
+ * stack faults instead of writing over other memory. The stacks of terminated threads are reused by later threads.
+ * It is an error to call this function with a null entry_point or a stack_size of 0.
+ *
+ * @return On success, return the ID of the created thread. On failure, return -1.
+*/
+int uthread_spawn_with_stack(thread_entry_point entry_point, size_t stack_size);
+
 
 /**
  * @brief Terminates the thread with ID tid and deletes it from all relevant control structures.
@@ -105,6 +131,8 @@ int uthread_get_tid();
  *
  * Right after the call to uthread_init, the value should be 1.
  * Each time a new quantum starts, regardless of the reason, this number should be increased by 1.
+ * When the library is built with UTHREADS_IDLE_AWARE, no quantum is counted while the running thread is the only
+ * thread that can run.
  *
  * @return The total number of quantums.
 */
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "MemoryConstants.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+* Function finds the non-zero words of an array, comparing a whole vector of words to zero at a
+* time when the target has AVX2 or SSE2, and word by word for the rest
+*@param words  the array, a frame of the RAM
+*@param count  the number of words
+*@param mask  gets bit i % 64 of mask[i / 64] set for every non-zero word i and every other bit
+*             cleared, it holds (count + 63) / 64 words
+*@return the number of non-zero words
+*/
+inline uint64_t findNonZeroWords(const word_t* words, uint64_t count, uint64_t* mask) {
+    for (uint64_t i = 0; i < (count + 63) / 64; i++) {
+        mask[i] = 0;
+    }
+    uint64_t found = 0;
+    uint64_t i = 0;
+#if defined(__AVX2__)
+    // the lanes of a vector divide 64, so the bits of a vector never straddle two mask words
+    constexpr uint64_t lanes = 32 / sizeof(word_t);
+    for (uint64_t end = count - count % lanes; i < end; i += lanes) {
+        __m256i vector = _mm256_loadu_si256((const __m256i*) (words + i));
+        uint64_t zeroes;
+        if constexpr (sizeof(word_t) == 4) {
+            zeroes = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(vector, _mm256_setzero_si256())));
+        }
+        else {
+            zeroes = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(vector, _mm256_setzero_si256())));
+        }
+        uint64_t bits = zeroes ^ ((1ULL << lanes) - 1);
+        mask[i / 64] |= bits << (i % 64);
+        found += __builtin_popcountll(bits);
+    }
+#elif defined(__SSE2__)
+    constexpr uint64_t lanes = 16 / sizeof(word_t);
+    for (uint64_t end = count - count % lanes; i < end; i += lanes) {
+        __m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) (words + i)), _mm_setzero_si128());
+        uint64_t zeroes;
+        if constexpr (sizeof(word_t) == 4) {
+            zeroes = _mm_movemask_ps(_mm_castsi128_ps(equal));
+        }
+        else {
+            // a 64 bit word is zero when both of its halves are
+            equal = _mm_and_si128(equal, _mm_shuffle_epi32(equal, 0xB1));
+            zeroes = _mm_movemask_pd(_mm_castsi128_pd(equal));
+        }
+        uint64_t bits = zeroes ^ ((1ULL << lanes) - 1);
+        mask[i / 64] |= bits << (i % 64);
+        found += __builtin_popcountll(bits);
+    }
+#endif
+    for (; i < count; i++) {
+        if (words[i] != 0) {
+            mask[i / 64] |= 1ULL << (i % 64);
+            found++;
+        }
+    }
+    return found;
+}
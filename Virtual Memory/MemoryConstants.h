@@ -3,23 +3,34 @@
 #include <climits>
 #include <stdint.h>
 
+// table entries hold frame indices in a word, 64 bit words let them index more than 2^30 frames
+#ifdef VM_64BIT_WORDS
+typedef int64_t word_t;
+#else
 typedef int word_t;
+#endif
 
 #define WORD_WIDTH (sizeof(word_t) * CHAR_BIT)
 
 // number of bits in the offset
+#ifndef OFFSET_WIDTH
 #define OFFSET_WIDTH 4
+#endif
 // page/frame size in words
 // in this implementation this is also the number of entries in a table
 #define PAGE_SIZE (1LL << OFFSET_WIDTH)
 
 // number of bits in a physical address
+#ifndef PHYSICAL_ADDRESS_WIDTH
 #define PHYSICAL_ADDRESS_WIDTH 10
+#endif
 // RAM size in words
 #define RAM_SIZE (1LL << PHYSICAL_ADDRESS_WIDTH)
 
 // number of bits in a virtual address
+#ifndef VIRTUAL_ADDRESS_WIDTH
 #define VIRTUAL_ADDRESS_WIDTH 20
+#endif
 // virtual memory size in words
 #define VIRTUAL_MEMORY_SIZE (1LL << VIRTUAL_ADDRESS_WIDTH)
 
@@ -29,5 +40,88 @@ typedef int word_t;
 // number of pages in the virtual memory
 #define NUM_PAGES (VIRTUAL_MEMORY_SIZE / PAGE_SIZE)
 
-#define CEIL(VARIABLE) ( (VARIABLE - (int)VARIABLE)==0 ? (int)VARIABLE : (int)VARIABLE+1 )
-#define TABLES_DEPTH CEIL((((VIRTUAL_ADDRESS_WIDTH - OFFSET_WIDTH) / (double)OFFSET_WIDTH)))
+// large page size in words, the pages translated by one entry of a last level table
+#define LARGE_PAGE_SIZE (PAGE_SIZE * PAGE_SIZE)
+
+/*
+ * The address layout of a virtual memory, everything derived at compile time
+ * from the three widths so several layouts can live in one binary.
+ */
+template <uint64_t OffsetWidth, uint64_t PhysicalAddressWidth, uint64_t VirtualAddressWidth>
+struct VMGeometry {
+    static_assert(OffsetWidth > 0, "pages must hold at least two words");
+    static_assert(PhysicalAddressWidth > OffsetWidth, "RAM must hold at least two frames");
+    static_assert(VirtualAddressWidth > OffsetWidth, "the virtual memory must hold at least two pages");
+    static_assert(PhysicalAddressWidth < 64 && VirtualAddressWidth < 64, "addresses must fit in uint64_t");
+
+    static constexpr uint64_t offsetWidth = OffsetWidth;
+    static constexpr uint64_t physicalAddressWidth = PhysicalAddressWidth;
+    static constexpr uint64_t virtualAddressWidth = VirtualAddressWidth;
+
+    static constexpr uint64_t pageSize = 1ULL << OffsetWidth;
+    static constexpr uint64_t ramSize = 1ULL << PhysicalAddressWidth;
+    static constexpr uint64_t virtualMemorySize = 1ULL << VirtualAddressWidth;
+    static constexpr uint64_t numFrames = ramSize / pageSize;
+    static constexpr uint64_t numPages = virtualMemorySize / pageSize;
+
+    // number of table levels, the page number bits divided into tables and rounded up
+    static constexpr uint64_t tablesDepth = (VirtualAddressWidth - 1) / OffsetWidth;
+    // the root table translates whatever bits are left over, a full table when the widths divide evenly
+    static constexpr uint64_t rootWidth = VirtualAddressWidth - tablesDepth * OffsetWidth;
+
+    static constexpr uint64_t offsetMask = pageSize - 1;
+    static constexpr uint64_t pageMask = numPages - 1;
+
+    /*
+     * Number of bits translated by a table of the given level.
+     */
+    static constexpr uint64_t levelWidth(uint64_t level) {
+        return level == 0 ? rootWidth : OffsetWidth;
+    }
+
+    /*
+     * Index of the entry the virtual address uses inside the table of the given level.
+     */
+    static constexpr uint64_t tableIndex(uint64_t virtualAddress, uint64_t level) {
+        return (virtualAddress >> ((tablesDepth - level) * OffsetWidth)) & ((1ULL << levelWidth(level)) - 1);
+    }
+
+    /*
+     * The bits of a page number that are translated above the given level.
+     */
+    static constexpr uint64_t pagePrefix(uint64_t page, uint64_t level) {
+        return page >> ((tablesDepth - level) * OffsetWidth);
+    }
+
+    static constexpr uint64_t getPage(uint64_t virtualAddress) {
+        return (virtualAddress >> OffsetWidth) & pageMask;
+    }
+
+    static constexpr uint64_t getOffset(uint64_t virtualAddress) {
+        return virtualAddress & offsetMask;
+    }
+};
+
+typedef VMGeometry<OFFSET_WIDTH, PHYSICAL_ADDRESS_WIDTH, VIRTUAL_ADDRESS_WIDTH> DefaultGeometry;
+
+#define TABLES_DEPTH (DefaultGeometry::tablesDepth)
+
+// number of bits in an address space id
+#define ASID_WIDTH 16
+// maximal number of address spaces
+#define MAX_ADDRESS_SPACES (1LL << ASID_WIDTH)
+
+// number of sets in the translation cache (must be a power of 2)
+#ifndef TLB_SETS
+#define TLB_SETS 16
+#endif
+
+// number of entries in every set of the translation cache
+#ifndef TLB_WAYS
+#define TLB_WAYS 4
+#endif
+
+// most pages the background reclaimer evicts before letting the faults and walks waiting for the tables in
+#ifndef RECLAIM_BATCH
+#define RECLAIM_BATCH 8
+#endif
@@ -0,0 +1,115 @@
+#include "MissRatio.h"
+#include <algorithm>
+
+// time slots of the tree before the first compaction
+#define INITIAL_TREE_SIZE 1024
+// the hash of a page is compared with the sampling rate in this many bits
+#define SAMPLING_BITS 24
+
+MissRatioAnalyzer::MissRatioAnalyzer(double samplingRate, uint64_t window)
+        : threshold((uint64_t) (samplingRate * (1ULL << SAMPLING_BITS))), rate(samplingRate), window(window) {
+    tree.assign(INITIAL_TREE_SIZE + 1, 0);
+}
+
+void MissRatioAnalyzer::reference(uint64_t page) {
+    std::lock_guard<std::mutex> guard(lock);
+    total++;
+    if (((page * 0x9E3779B97F4A7C15ULL) >> (64 - SAMPLING_BITS)) < threshold) {
+        sampled++;
+        if (now + 1 == tree.size()) {
+            compact();
+        }
+        uint64_t time = ++now;
+        auto found = lastReferences.find(page);
+        if (found == lastReferences.end()) {
+            coldMisses++;
+            windowPages++;
+            lastReferences.emplace(page, LastReference{time, windowIndex});
+        }
+        else {
+            // the followed pages referenced since, and this one
+            uint64_t distance = countUpTo(time - 1) - countUpTo(found->second.time) + 1;
+            uint64_t scaled = (uint64_t) (distance / rate + 0.5);
+            if (scaled >= distances.size()) {
+                distances.resize(scaled + 1, 0);
+            }
+            distances[scaled]++;
+            add(found->second.time, -1);
+            if (found->second.window != windowIndex) {
+                windowPages++;
+            }
+            found->second = LastReference{time, windowIndex};
+        }
+        add(time, 1);
+    }
+    if (window != 0 && total % window == 0) {
+        workingSets.push_back((uint64_t) (windowPages / rate + 0.5));
+        windowPages = 0;
+        windowIndex++;
+    }
+}
+
+void MissRatioAnalyzer::getCurve(uint64_t maxFrames, std::vector<double>* ratios) {
+    std::lock_guard<std::mutex> guard(lock);
+    ratios->assign(maxFrames + 1, 0);
+    if (sampled == 0) {
+        return;
+    }
+    // SHARDS-adj: a few hot pages in or out of the sample skew it, so the ratios are of the references
+    // the rate should have sampled, the difference going to the smallest distance (hits with one frame)
+    double expected = total * rate;
+    double misses = sampled;
+    for (uint64_t frames = 0; frames <= maxFrames; frames++) {
+        if (frames < distances.size()) {
+            misses -= distances[frames];
+        }
+        (*ratios)[frames] = frames == 0 ? 1 : std::min(std::max(misses / expected, 0.0), 1.0);
+    }
+}
+
+void MissRatioAnalyzer::getWorkingSet(std::vector<uint64_t>* sizes) {
+    std::lock_guard<std::mutex> guard(lock);
+    *sizes = workingSets;
+}
+
+uint64_t MissRatioAnalyzer::references() {
+    std::lock_guard<std::mutex> guard(lock);
+    return total;
+}
+
+void MissRatioAnalyzer::add(uint64_t time, int64_t delta) {
+    for (; time < tree.size(); time += time & (~time + 1)) {
+        tree[time] += delta;
+    }
+}
+
+uint64_t MissRatioAnalyzer::countUpTo(uint64_t time) const {
+    uint64_t count = 0;
+    for (; time > 0; time -= time & (~time + 1)) {
+        count += tree[time];
+    }
+    return count;
+}
+
+/**
+* Function renumbers the last references 1, 2, ... in their order once the tree runs out of time slots,
+* with room for as many references again
+*/
+void MissRatioAnalyzer::compact() {
+    std::vector<std::pair<uint64_t, LastReference*>> order;
+    order.reserve(lastReferences.size());
+    for (auto &entry : lastReferences) {
+        order.emplace_back(entry.second.time, &entry.second);
+    }
+    std::sort(order.begin(), order.end(), [](const std::pair<uint64_t, LastReference*> &a,
+                                             const std::pair<uint64_t, LastReference*> &b) {
+        return a.first < b.first;
+    });
+    uint64_t size = std::max<uint64_t>(2 * order.size(), INITIAL_TREE_SIZE);
+    tree.assign(size + 1, 0);
+    now = 0;
+    for (auto &entry : order) {
+        entry.second->time = ++now;
+        add(now, 1);
+    }
+}
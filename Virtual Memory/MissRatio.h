@@ -0,0 +1,82 @@
+#pragma once
+
+#include "MemoryConstants.h"
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+* Follows a stream of page references and gives, in one pass, the miss ratio an LRU memory of
+* every size would have had on it, and the working set size over time.
+*
+* The reuse (stack) distance of a reference is the number of distinct pages referenced since the
+* last reference to the same page, plus one: the fewest frames an LRU memory needs for it to hit.
+* Distances are counted with a Fenwick tree over the times of the last reference of every page,
+* so a reference costs O(log pages). With SHARDS sampling only the pages whose hash falls under
+* the sampling rate are followed, and their distances are scaled up by 1 / rate.
+* The working set size is the number of distinct pages referenced in every window of references.
+* References may come from several threads, they are counted in the order they take the lock.
+*/
+class MissRatioAnalyzer {
+public:
+    /**
+    *@param samplingRate  the fraction of the pages that is followed, in (0, 1]
+    *@param window  references per working set sample, 0 for no samples
+    */
+    MissRatioAnalyzer(double samplingRate, uint64_t window);
+
+    /**
+    *@param page  the page referenced, tagged with its address space
+    */
+    void reference(uint64_t page);
+
+    /**
+    * Function gives the miss ratio of an LRU memory of every size up to maxFrames frames,
+    * ratios[frames] for frames in [0, maxFrames]. A first reference is always a miss.
+    */
+    void getCurve(uint64_t maxFrames, std::vector<double>* ratios);
+
+    /**
+    * Function gives the working set size of every full window so far, in order
+    */
+    void getWorkingSet(std::vector<uint64_t>* sizes);
+
+    /**
+    * The number of references, sampled or not
+    */
+    uint64_t references();
+
+private:
+    /**
+    * What is kept of a followed page
+    *@param time  the slot of its last reference in the tree
+    *@param window  the window of its last reference
+    */
+    struct LastReference {
+        uint64_t time;
+        uint64_t window;
+    };
+
+    std::mutex lock;
+    uint64_t threshold;
+    double rate;
+    uint64_t window;
+
+    std::unordered_map<uint64_t, LastReference> lastReferences;
+    // a Fenwick tree holding a 1 at the time of the last reference of every followed page
+    std::vector<uint64_t> tree;
+    uint64_t now = 0;
+    // scaled stack distance -> sampled references, index 0 unused
+    std::vector<uint64_t> distances;
+    uint64_t coldMisses = 0;
+    uint64_t sampled = 0;
+    uint64_t total = 0;
+
+    uint64_t windowIndex = 0;
+    uint64_t windowPages = 0;
+    std::vector<uint64_t> workingSets;
+
+    void add(uint64_t time, int64_t delta);
+    uint64_t countUpTo(uint64_t time) const;
+    void compact();
+};
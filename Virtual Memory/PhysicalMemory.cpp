@@ -1,68 +1,247 @@
 #include "PhysicalMemory.h"
-#include <vector>
-#include <unordered_map>
+#include "FrameScan.h"
+#include "SwapDevice.h"
+#include <atomic>
+#include <memory>
 #include <cassert>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+
+#define RAM_BYTES (RAM_SIZE * sizeof(word_t))
+// slots the in-memory swap starts with, it doubles from there
+#define INITIAL_SWAP_SLOTS (NUM_FRAMES < 4096 ? NUM_FRAMES : 4096)
+
+// all frames back to back in one page aligned mapping
+word_t* RAM = nullptr;
+// where swapped out pages are kept, a pool in memory unless a file was chosen
+std::unique_ptr<SwapDevice> backingSwap;
+// the compressed tier in front of it, none when its capacity is 0
+std::unique_ptr<CompressedSwapDevice> compressedSwap;
+uint64_t compressedCapacity = 0;
+// the device pages are evicted to and restored from, the top of the two
+SwapDevice* swapFile = nullptr;
+// a frame is dirty once written after its page was restored, the flags are
+// atomic as concurrent translations write pages in parallel
+std::unique_ptr<std::atomic<uint8_t>[]> dirtyFrames;
+EvictionStats evictionStats = {0, 0, 0};
+
+/**
+* Function maps the RAM arena, backed by huge pages when PM_USE_HUGE_PAGES is defined and the
+* system has them reserved, otherwise by regular pages with transparent huge pages requested.
+* Regular pages are not reserved up front, so a large RAM only costs the frames that are used.
+*/
+word_t* mapArena() {
+    void* arena = MAP_FAILED;
+#if defined(PM_USE_HUGE_PAGES) && defined(MAP_HUGETLB)
+    arena = mmap(nullptr, RAM_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (arena == MAP_FAILED) {
+        arena = mmap(nullptr, RAM_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (arena == MAP_FAILED) {
+            fprintf(stderr, "system error: the RAM arena could not be mapped\n");
+            exit(1);
+        }
+#if defined(PM_USE_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+        madvise(arena, RAM_BYTES, MADV_HUGEPAGE);
+#endif
+    }
+    return (word_t*) arena;
+}
 
-typedef std::vector<word_t> page_t;
+/**
+* Function puts a new compressed tier (if it has a capacity) in front of the backing swap
+*/
+void stackSwap() {
+    compressedSwap.reset(compressedCapacity != 0 ? new CompressedSwapDevice(backingSwap.get(), compressedCapacity)
+                                                 : nullptr);
+    swapFile = compressedSwap != nullptr ? compressedSwap.get() : backingSwap.get();
+}
 
-std::vector<page_t> RAM;
-std::unordered_map<uint64_t, page_t> swapFile;
+void PMinitialize() {
+    if (RAM == nullptr) {
+        RAM = mapArena();
+    }
+    else if (madvise(RAM, RAM_BYTES, MADV_DONTNEED) != 0) {
+        // dropped pages of a private mapping read back as zeroes, huge pages may refuse
+        memset(RAM, 0, RAM_BYTES);
+    }
+    if (swapFile == nullptr) {
+        backingSwap.reset(new MemorySwapDevice(INITIAL_SWAP_SLOTS));
+        stackSwap();
+    }
+    else {
+        swapFile->clear();
+    }
+    if (dirtyFrames == nullptr) {
+        dirtyFrames.reset(new std::atomic<uint8_t>[NUM_FRAMES]);
+    }
+    for (uint64_t frame = 0; frame < NUM_FRAMES; frame++) {
+        dirtyFrames[frame].store(0, std::memory_order_relaxed);
+    }
+    PMresetEvictionStats();
+}
 
-void initialize() {
-    RAM.resize(NUM_FRAMES, page_t(PAGE_SIZE));
+int PMuseSwapFile(const char* path) {
+    if (swapFile != nullptr && swapFile->size() != 0) {
+        return 0;
+    }
+    if (path == nullptr) {
+        backingSwap.reset(new MemorySwapDevice(INITIAL_SWAP_SLOTS));
+        stackSwap();
+        return 1;
+    }
+    std::unique_ptr<FileSwapDevice> device = FileSwapDevice::open(path);
+    if (device == nullptr) {
+        return 0;
+    }
+    backingSwap = std::move(device);
+    stackSwap();
+    return 1;
 }
 
-void PMread(uint64_t physicalAddress, word_t* value) {
-    if (RAM.empty()) {
-        initialize();
+int PMuseCompressedSwap(uint64_t capacityBytes) {
+    if (swapFile != nullptr && swapFile->size() != 0) {
+        return 0;
+    }
+    compressedCapacity = capacityBytes;
+    if (swapFile != nullptr) {
+        stackSwap();
+    }
+    return 1;
+}
+
+void PMgetCompressedSwapStats(CompressedSwapStats* stats) {
+    if (compressedSwap == nullptr) {
+        *stats = CompressedSwapStats();
+        return;
     }
+    compressedSwap->getStats(stats);
+}
 
+void PMread(uint64_t physicalAddress, word_t* value) {
+    assert(RAM != nullptr);
     assert(physicalAddress < RAM_SIZE);
 
-    uint64_t frameIndex = physicalAddress / PAGE_SIZE;
-    uint64_t frameOffset = physicalAddress % PAGE_SIZE;
-    *value = RAM[frameIndex][frameOffset];
+    *value = RAM[physicalAddress];
  }
 
 void PMwrite(uint64_t physicalAddress, word_t value) {
-    if (RAM.empty()) {
-        initialize();
-    }
+    assert(RAM != nullptr);
+    assert(physicalAddress < RAM_SIZE);
+
+    RAM[physicalAddress] = value;
+    dirtyFrames[physicalAddress / PAGE_SIZE].store(1, std::memory_order_relaxed);
+}
 
+void PMreadRange(uint64_t physicalAddress, word_t* values, uint64_t count) {
+    assert(RAM != nullptr);
     assert(physicalAddress < RAM_SIZE);
+    assert(physicalAddress % PAGE_SIZE + count <= PAGE_SIZE);
 
-    uint64_t frameIndex = physicalAddress / PAGE_SIZE;
-    uint64_t frameOffset = physicalAddress % PAGE_SIZE;
-    RAM[frameIndex][frameOffset] = value;
+    memcpy(values, RAM + physicalAddress, count * sizeof(word_t));
 }
 
-void PMevict(uint64_t frameIndex, uint64_t evictedPageIndex) {
-    if (RAM.empty()) {
-        initialize();
+void PMwriteRange(uint64_t physicalAddress, const word_t* values, uint64_t count) {
+    assert(RAM != nullptr);
+    assert(physicalAddress < RAM_SIZE);
+    assert(physicalAddress % PAGE_SIZE + count <= PAGE_SIZE);
+
+    memcpy(RAM + physicalAddress, values, count * sizeof(word_t));
+    dirtyFrames[physicalAddress / PAGE_SIZE].store(1, std::memory_order_relaxed);
+}
+
+void PMfillRange(uint64_t physicalAddress, word_t value, uint64_t count) {
+    assert(RAM != nullptr);
+    assert(physicalAddress < RAM_SIZE);
+    assert(physicalAddress % PAGE_SIZE + count <= PAGE_SIZE);
+
+    word_t* words = RAM + physicalAddress;
+    dirtyFrames[physicalAddress / PAGE_SIZE].store(1, std::memory_order_relaxed);
+    if (value == 0) {
+        memset(words, 0, count * sizeof(word_t));
+        return;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        words[i] = value;
     }
+}
 
+void PMzeroFrame(uint64_t frameIndex) {
+    assert(RAM != nullptr);
     assert(frameIndex < NUM_FRAMES);
-    assert(evictedPageIndex < NUM_PAGES);
-    assert(swapFile.find(evictedPageIndex) == swapFile.end());
 
-    swapFile[evictedPageIndex] = RAM[frameIndex];
+    memset(RAM + frameIndex * PAGE_SIZE, 0, PAGE_SIZE * sizeof(word_t));
+    dirtyFrames[frameIndex].store(1, std::memory_order_relaxed);
 }
 
-void PMrestore(uint64_t frameIndex, uint64_t restoredPageIndex) {
-    if (RAM.empty()) {
-        initialize();
+void PMreadFrame(uint64_t frameIndex, word_t* values) {
+    assert(RAM != nullptr);
+    assert(frameIndex < NUM_FRAMES);
+
+    memcpy(values, RAM + frameIndex * PAGE_SIZE, PAGE_SIZE * sizeof(word_t));
+}
+
+void PMwriteFrame(uint64_t frameIndex, const word_t* values) {
+    assert(RAM != nullptr);
+    assert(frameIndex < NUM_FRAMES);
+
+    memcpy(RAM + frameIndex * PAGE_SIZE, values, PAGE_SIZE * sizeof(word_t));
+    dirtyFrames[frameIndex].store(1, std::memory_order_relaxed);
+}
+
+uint64_t PMfindNonZero(uint64_t frameIndex, uint64_t* mask) {
+    assert(RAM != nullptr);
+    assert(frameIndex < NUM_FRAMES);
+
+    return findNonZeroWords(RAM + frameIndex * PAGE_SIZE, PAGE_SIZE, mask);
+}
+
+void PMevict(uint64_t frameIndex, uint64_t evictedPageIndex) {
+    assert(RAM != nullptr);
+    assert(frameIndex < NUM_FRAMES);
+    assert(evictedPageIndex < NUM_PAGES * MAX_ADDRESS_SPACES);
+
+    if (!dirtyFrames[frameIndex].load(std::memory_order_relaxed)) {
+        evictionStats.cleanEvictions++;
+        return;
     }
+    evictionStats.dirtyEvictions++;
+    swapFile->store(evictedPageIndex, RAM + frameIndex * PAGE_SIZE);
+}
 
+void PMrestore(uint64_t frameIndex, uint64_t restoredPageIndex) {
+    assert(RAM != nullptr);
     assert(frameIndex < NUM_FRAMES);
 
     // page is not in swap file, so this is essentially
     // the first reference to this page. we can just return
     // as it doesn't matter if the page contains garbage
-    if (swapFile.find(restoredPageIndex) == swapFile.end()) {
-        return;
+    if (swapFile->load(restoredPageIndex, RAM + frameIndex * PAGE_SIZE)) {
+        evictionStats.restoredPages++;
     }
+    dirtyFrames[frameIndex].store(0, std::memory_order_relaxed);
+}
+
+int PMisSwapped(uint64_t pageIndex) {
+    assert(RAM != nullptr);
+
+    return swapFile->contains(pageIndex);
+}
+
+void PMdiscard(uint64_t firstPageIndex, uint64_t count) {
+    assert(RAM != nullptr);
+
+    swapFile->discardRange(firstPageIndex, count);
+}
+
+void PMgetEvictionStats(EvictionStats* stats) {
+    *stats = evictionStats;
+}
 
-    RAM[frameIndex] = std::move(swapFile[restoredPageIndex]);
-    swapFile.erase(restoredPageIndex);
+void PMresetEvictionStats() {
+    evictionStats.cleanEvictions = 0;
+    evictionStats.dirtyEvictions = 0;
+    evictionStats.restoredPages = 0;
 }
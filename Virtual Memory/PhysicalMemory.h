@@ -2,6 +2,57 @@
 
 #include "MemoryConstants.h"
 
+/*
+ * Maps the RAM (zeroed) and empties the swap file. Must be called before any
+ * other PM function, and calling it again starts over with empty memory.
+ * Defining PM_USE_HUGE_PAGES backs the RAM with huge pages when available.
+ */
+void PMinitialize();
+
+/*
+ * Keeps the swapped out pages in a file at 'path', created or truncated,
+ * instead of in memory; a null path goes back to memory. Writes to the file
+ * are batched by a background thread and restores read the following pages
+ * ahead. Can only be called while the swap is empty (e.g. right after
+ * VMinitialize).
+ *
+ * returns 1 on success.
+ * returns 0 if the swap is not empty or the file cannot be opened.
+ */
+int PMuseSwapFile(const char* path);
+
+/*
+ * Keeps up to capacityBytes of swapped out pages compressed in memory, in
+ * front of the swap (the file or the memory pool). A page that does not
+ * shrink to 3/4 of its size goes to the swap directly, and once the tier is
+ * full the pages stored or restored the longest ago move down to the swap.
+ * The tier saves reads and writes of a swap file, in front of the memory
+ * pool it only trades time for memory. A capacity of 0 (the default) removes
+ * the tier. Can only be called while the swap is empty.
+ *
+ * returns 1 on success.
+ * returns 0 if the swap is not empty.
+ */
+int PMuseCompressedSwap(uint64_t capacityBytes);
+
+/*
+ * The compressed tier of the swap: the pages it holds and the bytes they
+ * take, the pages stored in the swap below as they did not compress, and the
+ * pages moved down to make room. Counted since PMinitialize.
+ */
+struct CompressedSwapStats {
+    uint64_t compressedPages;
+    uint64_t compressedBytes;
+    uint64_t incompressiblePages;
+    uint64_t spilledPages;
+};
+
+/*
+ * Copies the counters of the compressed tier into *stats, zeroes if there is
+ * no such tier.
+ */
+void PMgetCompressedSwapStats(CompressedSwapStats* stats);
+
 /*
  * Reads an integer from the given physical address and puts it in 'value'.
  */
@@ -12,9 +63,59 @@ void PMread(uint64_t physicalAddress, word_t* value);
  */
 void PMwrite(uint64_t physicalAddress, word_t value);
 
+/*
+ * Reads 'count' consecutive words starting at the given physical address
+ * into 'values'. The range must not cross a frame boundary.
+ */
+void PMreadRange(uint64_t physicalAddress, word_t* values, uint64_t count);
+
+/*
+ * Writes 'count' consecutive words from 'values' starting at the given
+ * physical address. The range must not cross a frame boundary.
+ */
+void PMwriteRange(uint64_t physicalAddress, const word_t* values, uint64_t count);
+
+/*
+ * Writes 'value' to 'count' consecutive words starting at the given
+ * physical address. The range must not cross a frame boundary.
+ */
+void PMfillRange(uint64_t physicalAddress, word_t value, uint64_t count);
+
+/*
+ * Zeroes all PAGE_SIZE words of a frame.
+ */
+void PMzeroFrame(uint64_t frameIndex);
+
+/*
+ * Reads all PAGE_SIZE words of a frame into 'values'.
+ */
+void PMreadFrame(uint64_t frameIndex, word_t* values);
+
+/*
+ * Writes all PAGE_SIZE words of a frame from 'values'.
+ */
+void PMwriteFrame(uint64_t frameIndex, const word_t* values);
+
+/*
+ * Finds the non-zero words of a frame (the children of a table) with vector
+ * compares where the target supports them. Sets bit i % 64 of mask[i / 64]
+ * for every non-zero word i and clears the other bits, 'mask' holds
+ * (PAGE_SIZE + 63) / 64 words.
+ *
+ * returns the number of non-zero words.
+ */
+uint64_t PMfindNonZero(uint64_t frameIndex, uint64_t* mask);
+
 
 /*
- * Evicts a page from the RAM to the hard drive.
+ * Page indices passed to the functions below are tagged with their address
+ * space: asid * NUM_PAGES + page.
+ */
+
+/*
+ * Evicts a page from the RAM to the hard drive. A page that was not written
+ * since it was restored (or first referenced) is dropped without a write, as
+ * the copy on the hard drive (or the zeroes of a new page) are still valid.
  */
 void PMevict(uint64_t frameIndex, uint64_t evictedPageIndex);
 
@@ -23,3 +124,37 @@ void PMevict(uint64_t frameIndex, uint64_t evictedPageIndex);
  * Restores a page from the hard drive to the RAM.
  */
 void PMrestore(uint64_t frameIndex, uint64_t restoredPageIndex);
+
+/*
+ * returns 1 if the hard drive holds a copy of the page.
+ * returns 0 otherwise, the page was never written (or its copy was dropped)
+ * and holds zeroes.
+ */
+int PMisSwapped(uint64_t pageIndex);
+
+/*
+ * Drops the copies on the hard drive of every page in
+ * [firstPageIndex, firstPageIndex + count).
+ */
+void PMdiscard(uint64_t firstPageIndex, uint64_t count);
+
+/*
+ * Evictions that wrote the page to the hard drive (dirty), evictions that
+ * dropped an unmodified page (clean), and restores that found the page on
+ * the hard drive (a first reference has nothing to restore).
+ */
+struct EvictionStats {
+    uint64_t cleanEvictions;
+    uint64_t dirtyEvictions;
+    uint64_t restoredPages;
+};
+
+/*
+ * Copies the eviction counters into *stats.
+ */
+void PMgetEvictionStats(EvictionStats* stats);
+
+/*
+ * Zeroes the eviction counters.
+ */
+void PMresetEvictionStats();
@@ -0,0 +1,209 @@
+#include "ReplacementPolicy.h"
+
+/**
+* Function gives the key of a tagged page in the resident pages: its page number, then its address space
+*@param page  the page tagged with its address space
+*/
+uint64_t CyclicPolicy::getOrder(uint64_t page) const {
+    return (page % numPages) * MAX_ADDRESS_SPACES + page / numPages;
+}
+
+void CyclicPolicy::pageIn(uint64_t page, uint64_t frame) {
+    residentPages[getOrder(page)] = frame;
+}
+
+void CyclicPolicy::access(uint64_t, uint64_t) {
+}
+
+void CyclicPolicy::pageOut(uint64_t page, uint64_t) {
+    residentPages.erase(getOrder(page));
+}
+
+/**
+* Helper Function that calculate the Cyclic Distance between two pages
+*@param pageSwappedIn  the page we swap in the case no empty memory available
+*@param currAddress  the page we check the distance with
+*@return the distance between the pages
+*/
+uint64_t CyclicPolicy::getCyclicDistance(uint64_t pageSwappedIn, uint64_t currAddress) const {
+    uint64_t abs;
+    if (pageSwappedIn > currAddress) {
+        abs = pageSwappedIn - currAddress;
+    }
+    else {
+        abs = currAddress - pageSwappedIn;
+    }
+    uint64_t cyclicDistance = 0;
+    if ((numPages - abs) < abs) {
+        cyclicDistance = numPages - abs;
+    }
+    else {
+        cyclicDistance = abs;
+    }
+    return cyclicDistance;
+}
+
+/**
+* The page with the maximal cyclic distance is the resident page closest to the page
+* half way around the cycle, so only its two neighbours in page order are compared.
+*/
+uint64_t CyclicPolicy::selectVictim(uint64_t pageSwappedIn) {
+    pageSwappedIn %= numPages;
+    uint64_t opposite = (pageSwappedIn + numPages / 2) % numPages;
+    auto next = residentPages.lower_bound(opposite * MAX_ADDRESS_SPACES);
+    if (next == residentPages.end()) {
+        next = residentPages.begin();
+    }
+    auto prev = next == residentPages.begin() ? residentPages.end() : next;
+    --prev;
+    auto victim = next;
+    uint64_t nextDistance = getCyclicDistance(pageSwappedIn, next->first / MAX_ADDRESS_SPACES);
+    uint64_t prevDistance = getCyclicDistance(pageSwappedIn, prev->first / MAX_ADDRESS_SPACES);
+    if (prevDistance > nextDistance || (prevDistance == nextDistance && prev->first < next->first)) {
+        victim = prev;
+    }
+    return victim->second;
+}
+
+void LRUPolicy::pageIn(uint64_t, uint64_t frame) {
+    recency.pushFront(frame);
+}
+
+void LRUPolicy::access(uint64_t, uint64_t frame) {
+    recency.remove(frame);
+    recency.pushFront(frame);
+}
+
+void LRUPolicy::pageOut(uint64_t, uint64_t frame) {
+    recency.remove(frame);
+}
+
+uint64_t LRUPolicy::selectVictim(uint64_t) {
+    return recency.back();
+}
+
+void ClockPolicy::pageIn(uint64_t, uint64_t frame) {
+    resident[frame] = true;
+    referenced[frame] = true;
+}
+
+void ClockPolicy::access(uint64_t, uint64_t frame) {
+    referenced[frame] = true;
+}
+
+void ClockPolicy::pageOut(uint64_t, uint64_t frame) {
+    resident[frame] = false;
+    referenced[frame] = false;
+}
+
+uint64_t ClockPolicy::selectVictim(uint64_t) {
+    // frames holding tables are skipped, every referenced page gets a second chance
+    while (true) {
+        uint64_t frame = hand;
+        hand = (hand + 1) % resident.size();
+        if (!resident[frame]) {
+            continue;
+        }
+        if (!referenced[frame]) {
+            return frame;
+        }
+        referenced[frame] = false;
+    }
+}
+
+void ARCPolicy::pageIn(uint64_t page, uint64_t frame) {
+    if (recentGhosts.contains(page)) {
+        uint64_t delta = recentGhosts.pages.size() >= frequentGhosts.pages.size() ? 1 :
+                         frequentGhosts.pages.size() / recentGhosts.pages.size();
+        target = target + delta < capacity ? target + delta : capacity;
+        recentGhosts.erase(page);
+        frequent.pushFront(frame);
+        inFrequent[frame] = true;
+        return;
+    }
+    if (frequentGhosts.contains(page)) {
+        uint64_t delta = frequentGhosts.pages.size() >= recentGhosts.pages.size() ? 1 :
+                         recentGhosts.pages.size() / frequentGhosts.pages.size();
+        target = target > delta ? target - delta : 0;
+        frequentGhosts.erase(page);
+        frequent.pushFront(frame);
+        inFrequent[frame] = true;
+        return;
+    }
+    // a page never seen before, keep the directory within twice the capacity
+    if (recent.size() + recentGhosts.pages.size() >= capacity && !recentGhosts.pages.empty()) {
+        recentGhosts.popBack();
+    }
+    while (recentGhosts.pages.size() + frequentGhosts.pages.size() >= capacity && !frequentGhosts.pages.empty()) {
+        frequentGhosts.popBack();
+    }
+    recent.pushFront(frame);
+    inFrequent[frame] = false;
+}
+
+void ARCPolicy::access(uint64_t, uint64_t frame) {
+    if (inFrequent[frame]) {
+        frequent.remove(frame);
+    }
+    else {
+        recent.remove(frame);
+        inFrequent[frame] = true;
+    }
+    frequent.pushFront(frame);
+}
+
+void ARCPolicy::pageOut(uint64_t page, uint64_t frame) {
+    if (inFrequent[frame]) {
+        frequent.remove(frame);
+        frequentGhosts.push(page);
+    }
+    else {
+        recent.remove(frame);
+        recentGhosts.push(page);
+    }
+    inFrequent[frame] = false;
+}
+
+uint64_t ARCPolicy::selectVictim(uint64_t pageSwappedIn) {
+    bool takeRecent = recent.size() > 0 &&
+                      (recent.size() > target || (frequentGhosts.contains(pageSwappedIn) && recent.size() == target));
+    if (takeRecent || frequent.size() == 0) {
+        return recent.back();
+    }
+    return frequent.back();
+}
+
+void RandomPolicy::pageIn(uint64_t, uint64_t frame) {
+    position[frame] = frames.size();
+    frames.push_back(frame);
+}
+
+void RandomPolicy::access(uint64_t, uint64_t) {
+}
+
+void RandomPolicy::pageOut(uint64_t, uint64_t frame) {
+    uint64_t last = frames.back();
+    frames[position[frame]] = last;
+    position[last] = position[frame];
+    frames.pop_back();
+}
+
+uint64_t RandomPolicy::selectVictim(uint64_t) {
+    return frames[generator() % frames.size()];
+}
+
+std::unique_ptr<ReplacementPolicy> createReplacementPolicy(ReplacementPolicyType type, uint64_t numFrames,
+                                                           uint64_t numPages) {
+    switch (type) {
+        case LRU_POLICY:
+            return std::unique_ptr<ReplacementPolicy>(new LRUPolicy(numFrames));
+        case CLOCK_POLICY:
+            return std::unique_ptr<ReplacementPolicy>(new ClockPolicy(numFrames));
+        case ARC_POLICY:
+            return std::unique_ptr<ReplacementPolicy>(new ARCPolicy(numFrames));
+        case RANDOM_POLICY:
+            return std::unique_ptr<ReplacementPolicy>(new RandomPolicy(numFrames));
+        default:
+            return std::unique_ptr<ReplacementPolicy>(new CyclicPolicy(numPages));
+    }
+}
@@ -0,0 +1,235 @@
+#pragma once
+
+#include "MemoryConstants.h"
+#include "VirtualMemory.h"
+#include <list>
+#include <map>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+/**
+* Decides which resident page is evicted when every frame is in use.
+* The engine reports every page that becomes resident, every access to a resident page
+* and every page that leaves its frame; only frames holding pages are ever passed in.
+* Pages are tagged with their address space (asid * numPages + page), so one policy
+* chooses among the pages of every address space.
+*/
+class ReplacementPolicy {
+public:
+    virtual ~ReplacementPolicy() = default;
+
+    /**
+    * A page was brought into a frame (a page fault)
+    */
+    virtual void pageIn(uint64_t page, uint64_t frame) = 0;
+
+    /**
+    * A resident page was accessed
+    */
+    virtual void access(uint64_t page, uint64_t frame) = 0;
+
+    /**
+    * A page left its frame (it was evicted)
+    */
+    virtual void pageOut(uint64_t page, uint64_t frame) = 0;
+
+    /**
+    * Chooses the frame of the page to evict, called only while some page is resident
+    *@param pageSwappedIn  the page we want to swap in
+    *@return the frame of the victim page
+    */
+    virtual uint64_t selectVictim(uint64_t pageSwappedIn) = 0;
+
+    /**
+    * Whether access does anything, the engine skips reporting hits (and locking for them) otherwise
+    */
+    virtual bool tracksAccesses() const {
+        return true;
+    }
+};
+
+/**
+* Intrusive doubly linked list over frame indices, the head is the most recently inserted frame
+*/
+class FrameList {
+public:
+    explicit FrameList(uint64_t numFrames) : prev(numFrames + 1), next(numFrames + 1), count(0) {
+        uint64_t head = numFrames;
+        prev[head] = head;
+        next[head] = head;
+    }
+
+    void pushFront(uint64_t frame) {
+        uint64_t head = prev.size() - 1;
+        prev[frame] = head;
+        next[frame] = next[head];
+        prev[next[head]] = frame;
+        next[head] = frame;
+        count++;
+    }
+
+    void remove(uint64_t frame) {
+        next[prev[frame]] = next[frame];
+        prev[next[frame]] = prev[frame];
+        count--;
+    }
+
+    uint64_t back() const {
+        return prev[prev.size() - 1];
+    }
+
+    uint64_t size() const {
+        return count;
+    }
+
+private:
+    std::vector<uint64_t> prev;
+    std::vector<uint64_t> next;
+    uint64_t count;
+};
+
+/**
+* Evicts the page with the maximal cyclic distance from the incoming page, lower page on a tie.
+* The distance ignores the address space, so pages at the same place in different spaces tie.
+*/
+class CyclicPolicy : public ReplacementPolicy {
+public:
+    explicit CyclicPolicy(uint64_t numPages) : numPages(numPages) {}
+
+    void pageIn(uint64_t page, uint64_t frame) override;
+    void access(uint64_t page, uint64_t frame) override;
+    void pageOut(uint64_t page, uint64_t frame) override;
+    uint64_t selectVictim(uint64_t pageSwappedIn) override;
+
+    bool tracksAccesses() const override {
+        return false;
+    }
+
+private:
+    uint64_t numPages;
+    // resident pages ordered by page number and then by address space, mapped to the frame holding them
+    std::map<uint64_t, uint64_t> residentPages;
+
+    uint64_t getCyclicDistance(uint64_t pageSwappedIn, uint64_t currAddress) const;
+    uint64_t getOrder(uint64_t page) const;
+};
+
+/**
+* Evicts the least recently used page
+*/
+class LRUPolicy : public ReplacementPolicy {
+public:
+    explicit LRUPolicy(uint64_t numFrames) : recency(numFrames) {}
+
+    void pageIn(uint64_t page, uint64_t frame) override;
+    void access(uint64_t page, uint64_t frame) override;
+    void pageOut(uint64_t page, uint64_t frame) override;
+    uint64_t selectVictim(uint64_t pageSwappedIn) override;
+
+private:
+    FrameList recency;
+};
+
+/**
+* Second chance: a hand sweeps the frames and evicts the first page not referenced since the last sweep
+*/
+class ClockPolicy : public ReplacementPolicy {
+public:
+    explicit ClockPolicy(uint64_t numFrames) : referenced(numFrames, false), resident(numFrames, false), hand(0) {}
+
+    void pageIn(uint64_t page, uint64_t frame) override;
+    void access(uint64_t page, uint64_t frame) override;
+    void pageOut(uint64_t page, uint64_t frame) override;
+    uint64_t selectVictim(uint64_t pageSwappedIn) override;
+
+private:
+    std::vector<bool> referenced;
+    std::vector<bool> resident;
+    uint64_t hand;
+};
+
+/**
+* Adaptive Replacement Cache (Megiddo & Modha): resident pages seen once (T1) and more than once (T2),
+* with ghost lists of recently evicted pages (B1, B2) steering the target size of T1.
+* The capacity is the number of frames, as tables share the frames with pages.
+*/
+class ARCPolicy : public ReplacementPolicy {
+public:
+    explicit ARCPolicy(uint64_t numFrames)
+            : capacity(numFrames), target(0), recent(numFrames), frequent(numFrames), inFrequent(numFrames, false) {}
+
+    void pageIn(uint64_t page, uint64_t frame) override;
+    void access(uint64_t page, uint64_t frame) override;
+    void pageOut(uint64_t page, uint64_t frame) override;
+    uint64_t selectVictim(uint64_t pageSwappedIn) override;
+
+private:
+    /**
+    * A list of evicted pages, most recently evicted at the front
+    */
+    struct GhostList {
+        std::list<uint64_t> pages;
+        std::unordered_map<uint64_t, std::list<uint64_t>::iterator> index;
+
+        bool contains(uint64_t page) const {
+            return index.find(page) != index.end();
+        }
+
+        void push(uint64_t page) {
+            pages.push_front(page);
+            index[page] = pages.begin();
+        }
+
+        void erase(uint64_t page) {
+            auto it = index.find(page);
+            pages.erase(it->second);
+            index.erase(it);
+        }
+
+        void popBack() {
+            index.erase(pages.back());
+            pages.pop_back();
+        }
+    };
+
+    uint64_t capacity;
+    uint64_t target;
+    FrameList recent;
+    FrameList frequent;
+    std::vector<bool> inFrequent;
+    GhostList recentGhosts;
+    GhostList frequentGhosts;
+};
+
+/**
+* Evicts a uniformly random resident page
+*/
+class RandomPolicy : public ReplacementPolicy {
+public:
+    explicit RandomPolicy(uint64_t numFrames) : position(numFrames), generator(numFrames) {}
+
+    void pageIn(uint64_t page, uint64_t frame) override;
+    void access(uint64_t page, uint64_t frame) override;
+    void pageOut(uint64_t page, uint64_t frame) override;
+    uint64_t selectVictim(uint64_t pageSwappedIn) override;
+
+    bool tracksAccesses() const override {
+        return false;
+    }
+
+private:
+    std::vector<uint64_t> frames;
+    std::vector<uint64_t> position;
+    std::mt19937_64 generator;
+};
+
+/**
+* Creates a policy of the given type
+*@param type  the replacement policy
+*@param numFrames  the number of frames of the RAM
+*@param numPages  the number of pages of the virtual memory
+*/
+std::unique_ptr<ReplacementPolicy> createReplacementPolicy(ReplacementPolicyType type, uint64_t numFrames,
+                                                           uint64_t numPages);
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "MemoryConstants.h"
+#include "FrameScan.h"
+#include <algorithm>
+#include <cassert>
+#include <unordered_map>
+#include <vector>
+
+/**
+* A self contained RAM and swap for any geometry, so engines of several geometries
+* can run side by side in one binary (the PM* functions are fixed to the default geometry)
+*@param Geometry  the VMGeometry the memory is sized for
+*/
+template <class Geometry>
+class SimulatedPhysicalMemory {
+public:
+    SimulatedPhysicalMemory() : ram(Geometry::ramSize) {}
+
+    void read(uint64_t physicalAddress, word_t* value) {
+        assert(physicalAddress < Geometry::ramSize);
+        *value = ram[physicalAddress];
+    }
+
+    void write(uint64_t physicalAddress, word_t value) {
+        assert(physicalAddress < Geometry::ramSize);
+        ram[physicalAddress] = value;
+    }
+
+    void readRange(uint64_t physicalAddress, word_t* values, uint64_t count) {
+        assert(physicalAddress % Geometry::pageSize + count <= Geometry::pageSize);
+        std::copy_n(ram.begin() + physicalAddress, count, values);
+    }
+
+    void writeRange(uint64_t physicalAddress, const word_t* values, uint64_t count) {
+        assert(physicalAddress % Geometry::pageSize + count <= Geometry::pageSize);
+        std::copy_n(values, count, ram.begin() + physicalAddress);
+    }
+
+    void fillRange(uint64_t physicalAddress, word_t value, uint64_t count) {
+        assert(physicalAddress % Geometry::pageSize + count <= Geometry::pageSize);
+        std::fill_n(ram.begin() + physicalAddress, count, value);
+    }
+
+    void zeroFrame(uint64_t frameIndex) {
+        assert(frameIndex < Geometry::numFrames);
+        std::fill_n(ram.begin() + frameIndex * Geometry::pageSize, Geometry::pageSize, 0);
+    }
+
+    void readFrame(uint64_t frameIndex, word_t* values) {
+        assert(frameIndex < Geometry::numFrames);
+        std::copy_n(ram.begin() + frameIndex * Geometry::pageSize, Geometry::pageSize, values);
+    }
+
+    void writeFrame(uint64_t frameIndex, const word_t* values) {
+        assert(frameIndex < Geometry::numFrames);
+        std::copy_n(values, Geometry::pageSize, ram.begin() + frameIndex * Geometry::pageSize);
+    }
+
+    uint64_t findNonZero(uint64_t frameIndex, uint64_t* mask) {
+        assert(frameIndex < Geometry::numFrames);
+        return findNonZeroWords(ram.data() + frameIndex * Geometry::pageSize, Geometry::pageSize, mask);
+    }
+
+    void evict(uint64_t frameIndex, uint64_t evictedPageIndex) {
+        assert(frameIndex < Geometry::numFrames);
+        assert(swapFile.find(evictedPageIndex) == swapFile.end());
+        auto frame = ram.begin() + frameIndex * Geometry::pageSize;
+        swapFile[evictedPageIndex].assign(frame, frame + Geometry::pageSize);
+    }
+
+    void restore(uint64_t frameIndex, uint64_t restoredPageIndex) {
+        assert(frameIndex < Geometry::numFrames);
+        auto page = swapFile.find(restoredPageIndex);
+        if (page == swapFile.end()) {
+            return;
+        }
+        std::copy(page->second.begin(), page->second.end(), ram.begin() + frameIndex * Geometry::pageSize);
+        swapFile.erase(page);
+    }
+
+    bool isSwapped(uint64_t pageIndex) {
+        return swapFile.find(pageIndex) != swapFile.end();
+    }
+
+    void discard(uint64_t firstPageIndex, uint64_t count) {
+        for (auto page = swapFile.begin(); page != swapFile.end();) {
+            if (page->first - firstPageIndex < count) {
+                page = swapFile.erase(page);
+            }
+            else {
+                ++page;
+            }
+        }
+    }
+
+private:
+    std::vector<word_t> ram;
+    std::unordered_map<uint64_t, std::vector<word_t>> swapFile;
+};
@@ -0,0 +1,749 @@
+#include "SwapDevice.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define PAGE_BYTES (PAGE_SIZE * sizeof(word_t))
+
+// how long the writer thread lets a partial batch wait
+#define WRITE_BEHIND_DELAY std::chrono::milliseconds(10)
+
+// initial number of buckets of a swap index (a power of 2)
+#define INITIAL_INDEX_SIZE 1024
+
+// the compressed pool hands out blocks in steps of CLASS_BYTES, one size class per step
+#define CLASS_BYTES ((PAGE_BYTES + 15) / 16)
+// a page is kept compressed only if its encoding takes at most 3/4 of the page
+#define MAX_ENCODED_BYTES (PAGE_BYTES * 3 / 4)
+#define NUM_CLASSES ((MAX_ENCODED_BYTES + CLASS_BYTES - 1) / CLASS_BYTES)
+// the most words a token of an encoded page covers
+#define MAX_RUN 128
+
+void SwapIndex::reset(uint64_t capacity) {
+    pages.assign(capacity, NO_PAGE);
+    slots.assign(capacity, 0);
+    count = 0;
+}
+
+uint64_t SwapIndex::bucketOf(uint64_t page) const {
+    return (page * 0x9E3779B97F4A7C15ULL) & (pages.size() - 1);
+}
+
+uint64_t SwapIndex::find(uint64_t page) const {
+    for (uint64_t i = bucketOf(page); pages[i] != NO_PAGE; i = (i + 1) & (pages.size() - 1)) {
+        if (pages[i] == page) {
+            return i;
+        }
+    }
+    return NO_PAGE;
+}
+
+void SwapIndex::insert(uint64_t page, uint64_t slot) {
+    if (2 * (count + 1) > pages.size()) {
+        grow();
+    }
+    uint64_t i = bucketOf(page);
+    while (pages[i] != NO_PAGE) {
+        i = (i + 1) & (pages.size() - 1);
+    }
+    pages[i] = page;
+    slots[i] = slot;
+    count++;
+}
+
+void SwapIndex::erase(uint64_t bucket) {
+    uint64_t mask = pages.size() - 1;
+    uint64_t hole = bucket;
+    for (uint64_t i = (hole + 1) & mask; pages[i] != NO_PAGE; i = (i + 1) & mask) {
+        uint64_t home = bucketOf(pages[i]);
+        // move the entry back unless its home lies cyclically in (hole, i]
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            pages[hole] = pages[i];
+            slots[hole] = slots[i];
+            hole = i;
+        }
+    }
+    pages[hole] = NO_PAGE;
+    count--;
+}
+
+void SwapIndex::grow() {
+    std::vector<uint64_t> oldPages;
+    std::vector<uint64_t> oldSlots;
+    oldPages.swap(pages);
+    oldSlots.swap(slots);
+    reset(oldPages.size() * 2);
+    for (uint64_t i = 0; i < oldPages.size(); i++) {
+        if (oldPages[i] != NO_PAGE) {
+            insert(oldPages[i], oldSlots[i]);
+        }
+    }
+}
+
+/**
+* Function lists the stored pages in [firstPage, firstPage + count)
+*/
+std::vector<uint64_t> SwapIndex::pagesIn(uint64_t firstPage, uint64_t count) const {
+    std::vector<uint64_t> found;
+    for (uint64_t page : pages) {
+        if (page != NO_PAGE && page - firstPage < count) {
+            found.push_back(page);
+        }
+    }
+    return found;
+}
+
+MemorySwapDevice::MemorySwapDevice(uint64_t initialSlots) : initialSlots(initialSlots) {
+    clear();
+}
+
+void MemorySwapDevice::clear() {
+    pool.assign(initialSlots * PAGE_SIZE, 0);
+    freeSlots.clear();
+    for (uint64_t slot = initialSlots; slot > 0; slot--) {
+        freeSlots.push_back(slot - 1);
+    }
+    index.reset(2 * initialSlots);
+}
+
+uint64_t MemorySwapDevice::size() {
+    return index.count;
+}
+
+bool MemorySwapDevice::contains(uint64_t page) {
+    return index.find(page) != NO_PAGE;
+}
+
+/**
+* Function takes a free slot of the pool, doubling the pool if none is left
+*/
+uint64_t MemorySwapDevice::allocateSlot() {
+    if (freeSlots.empty()) {
+        uint64_t slots = pool.size() / PAGE_SIZE;
+        pool.resize(2 * slots * PAGE_SIZE);
+        for (uint64_t slot = 2 * slots; slot > slots; slot--) {
+            freeSlots.push_back(slot - 1);
+        }
+    }
+    uint64_t slot = freeSlots.back();
+    freeSlots.pop_back();
+    return slot;
+}
+
+void MemorySwapDevice::store(uint64_t page, const word_t* data) {
+    uint64_t bucket = index.find(page);
+    uint64_t slot;
+    if (bucket == NO_PAGE) {
+        slot = allocateSlot();
+        index.insert(page, slot);
+    }
+    else {
+        slot = index.slots[bucket];
+    }
+    memcpy(&pool[slot * PAGE_SIZE], data, PAGE_BYTES);
+}
+
+bool MemorySwapDevice::load(uint64_t page, word_t* data) {
+    uint64_t bucket = index.find(page);
+    if (bucket == NO_PAGE) {
+        return false;
+    }
+    memcpy(data, &pool[index.slots[bucket] * PAGE_SIZE], PAGE_BYTES);
+    return true;
+}
+
+void MemorySwapDevice::discard(uint64_t page) {
+    uint64_t bucket = index.find(page);
+    if (bucket == NO_PAGE) {
+        return;
+    }
+    freeSlots.push_back(index.slots[bucket]);
+    index.erase(bucket);
+}
+
+void MemorySwapDevice::discardRange(uint64_t firstPage, uint64_t count) {
+    for (uint64_t page : index.pagesIn(firstPage, count)) {
+        discard(page);
+    }
+}
+
+/**
+* Function writes a whole page to a slot of a swap file, continuing after partial and interrupted writes
+*@param fd  the swap file
+*@param data  the page
+*@param slot  the slot of the page
+*@return false if the write failed, the slot may hold part of the page then
+*/
+static bool writePage(int fd, const word_t* data, uint64_t slot) {
+    const char* bytes = (const char*) data;
+    for (uint64_t done = 0; done < PAGE_BYTES;) {
+        ssize_t written = pwrite(fd, bytes + done, PAGE_BYTES - done, (off_t) (slot * PAGE_BYTES + done));
+        if (written == -1 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        done += written;
+    }
+    return true;
+}
+
+/**
+* Function reads a whole page from a slot of a swap file, continuing after partial and interrupted reads
+*@param fd  the swap file
+*@param data  gets the page
+*@param slot  the slot of the page
+*@return false if the read failed or the file ends inside the slot
+*/
+static bool readPage(int fd, word_t* data, uint64_t slot) {
+    char* bytes = (char*) data;
+    for (uint64_t done = 0; done < PAGE_BYTES;) {
+        ssize_t read = pread(fd, bytes + done, PAGE_BYTES - done, (off_t) (slot * PAGE_BYTES + done));
+        if (read == -1 && errno == EINTR) {
+            continue;
+        }
+        if (read <= 0) {
+            return false;
+        }
+        done += read;
+    }
+    return true;
+}
+
+FileSwapDevice::FileSwapDevice(int fd) : fd(fd) {
+    index.reset(INITIAL_INDEX_SIZE);
+    writer = std::thread(&FileSwapDevice::run, this);
+}
+
+FileSwapDevice::~FileSwapDevice() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+    close(fd);
+}
+
+std::unique_ptr<FileSwapDevice> FileSwapDevice::open(const char* path) {
+    int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1) {
+        return nullptr;
+    }
+    return std::unique_ptr<FileSwapDevice>(new FileSwapDevice(fd));
+}
+
+void FileSwapDevice::clear() {
+    std::lock_guard<std::mutex> guard(lock);
+    // queued writes are dropped, a batch already being written only lands in slots that are free now
+    for (auto &write : writeQueue) {
+        write->page = NO_PAGE;
+    }
+    for (auto &write : failedWrites) {
+        write->page = NO_PAGE;
+    }
+    writeQueue.clear();
+    failedWrites.clear();
+    pending.clear();
+    readQueue.clear();
+    readCache.clear();
+    readCacheOrder.clear();
+    generations.clear();
+    index.reset(INITIAL_INDEX_SIZE);
+    freeSlots.clear();
+    nextSlot = 0;
+}
+
+uint64_t FileSwapDevice::size() {
+    std::lock_guard<std::mutex> guard(lock);
+    return index.count;
+}
+
+bool FileSwapDevice::contains(uint64_t page) {
+    std::lock_guard<std::mutex> guard(lock);
+    return index.find(page) != NO_PAGE;
+}
+
+void FileSwapDevice::store(uint64_t page, const word_t* data) {
+    std::unique_lock<std::mutex> guard(lock);
+    // the slot of a replaced copy may be handed right back, a write of the old copy still in flight
+    // cannot land over the new one as the single writer thread writes the batches in the order they
+    // were queued, and the new copy is only queued after the old one was
+    discardLocked(page);
+    uint64_t slot;
+    if (freeSlots.empty()) {
+        slot = nextSlot++;
+    }
+    else {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    index.insert(page, slot);
+    generations[page] = ++generation;
+    readCache.erase(page);
+
+    auto write = std::make_shared<PendingWrite>();
+    write->page = page;
+    write->slot = slot;
+    write->data.assign(data, data + PAGE_SIZE);
+    pending[page] = write;
+    writeQueue.push_back(write);
+    if (writeQueue.size() >= SWAP_WRITE_BATCH) {
+        guard.unlock();
+        wake.notify_one();
+    }
+}
+
+bool FileSwapDevice::load(uint64_t page, word_t* data) {
+    std::unique_lock<std::mutex> guard(lock);
+    uint64_t bucket = index.find(page);
+    if (bucket == NO_PAGE) {
+        return false;
+    }
+
+    auto write = pending.find(page);
+    auto cached = readCache.find(page);
+    if (write != pending.end()) {
+        // not on disk yet
+        memcpy(data, write->second->data.data(), PAGE_BYTES);
+    }
+    else if (cached != readCache.end()) {
+        memcpy(data, cached->second.data(), PAGE_BYTES);
+        readCache.erase(cached);
+    }
+    else if (!readPage(fd, data, index.slots[bucket])) {
+        // the page was written, so it cannot be made up
+        fprintf(stderr, "system error: a page could not be read from the swap file\n");
+        exit(1);
+    }
+
+    queueReadAhead(page);
+    bool readAhead = !readQueue.empty();
+    guard.unlock();
+    if (readAhead) {
+        wake.notify_one();
+    }
+    return true;
+}
+
+void FileSwapDevice::discard(uint64_t page) {
+    std::lock_guard<std::mutex> guard(lock);
+    discardLocked(page);
+}
+
+void FileSwapDevice::discardRange(uint64_t firstPage, uint64_t count) {
+    std::lock_guard<std::mutex> guard(lock);
+    for (uint64_t page : index.pagesIn(firstPage, count)) {
+        discardLocked(page);
+    }
+}
+
+/**
+* Function drops the stored copy of a page while the lock is held, a write still queued is cancelled
+*@param page  the page to drop
+*/
+void FileSwapDevice::discardLocked(uint64_t page) {
+    uint64_t bucket = index.find(page);
+    if (bucket == NO_PAGE) {
+        return;
+    }
+    auto write = pending.find(page);
+    if (write != pending.end()) {
+        write->second->page = NO_PAGE;
+        pending.erase(write);
+    }
+    readCache.erase(page);
+    generations.erase(page);
+    freeSlots.push_back(index.slots[bucket]);
+    index.erase(bucket);
+}
+
+/**
+* Function queues the stored pages following a restored page to be read ahead
+*@param page  the page that was restored
+*/
+void FileSwapDevice::queueReadAhead(uint64_t page) {
+    for (uint64_t next = page + 1; next <= page + SWAP_READAHEAD; next++) {
+        uint64_t bucket = index.find(next);
+        if (bucket == NO_PAGE || pending.count(next) != 0 || readCache.count(next) != 0) {
+            continue;
+        }
+        readQueue.push_back({next, index.slots[bucket], generations[next]});
+    }
+}
+
+/**
+* The writer thread: flushes full batches at once and partial batches after WRITE_BEHIND_DELAY,
+* and serves the read ahead requests
+*/
+void FileSwapDevice::run() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        bool woken = wake.wait_for(guard, WRITE_BEHIND_DELAY, [this] {
+            return stopping || writeQueue.size() >= SWAP_WRITE_BATCH || !readQueue.empty();
+        });
+        if (!writeQueue.empty() && (!woken || stopping || writeQueue.size() >= SWAP_WRITE_BATCH)) {
+            writeBatch(guard);
+        }
+        if (!readQueue.empty()) {
+            readAhead(guard);
+        }
+        if (stopping && writeQueue.empty()) {
+            return;
+        }
+    }
+}
+
+/**
+* Function writes every queued page to its slot, in slot order, without holding the lock during the writes.
+* A page whose write fails stays pending, so it is restored from memory, and it is written again with the
+* next batch
+*@param guard  the held lock of the device
+*/
+void FileSwapDevice::writeBatch(std::unique_lock<std::mutex> &guard) {
+    // the failed writes are older than the queued ones, so they go first
+    std::vector<std::shared_ptr<PendingWrite>> batch;
+    for (auto &write : failedWrites) {
+        if (write->page != NO_PAGE) {
+            batch.push_back(write);
+        }
+    }
+    failedWrites.clear();
+    for (auto &write : writeQueue) {
+        if (write->page != NO_PAGE) {
+            batch.push_back(write);
+        }
+    }
+    writeQueue.clear();
+    guard.unlock();
+
+    // a stable sort keeps two writes to the same slot in the order they were stored
+    std::stable_sort(batch.begin(), batch.end(), [](const std::shared_ptr<PendingWrite> &a,
+                                                    const std::shared_ptr<PendingWrite> &b) {
+        return a->slot < b->slot;
+    });
+    std::vector<bool> written(batch.size());
+    for (uint64_t i = 0; i < batch.size(); i++) {
+        written[i] = writePage(fd, batch[i]->data.data(), batch[i]->slot);
+    }
+
+    guard.lock();
+    uint64_t failed = 0;
+    for (uint64_t i = 0; i < batch.size(); i++) {
+        auto &write = batch[i];
+        if (!written[i]) {
+            if (write->page != NO_PAGE) {
+                failedWrites.push_back(write);
+                failed++;
+            }
+            continue;
+        }
+        auto entry = write->page == NO_PAGE ? pending.end() : pending.find(write->page);
+        if (entry != pending.end() && entry->second == write) {
+            pending.erase(entry);
+        }
+    }
+    if (failed != 0) {
+        fprintf(stderr, "system error: %llu pages could not be written to the swap file, they are kept in memory\n",
+                (unsigned long long) failed);
+    }
+}
+
+/**
+* Function reads the queued pages into the read ahead cache, dropping pages that were restored
+* or stored again while they were read
+*@param guard  the held lock of the device
+*/
+void FileSwapDevice::readAhead(std::unique_lock<std::mutex> &guard) {
+    std::vector<ReadAhead> requests(readQueue.begin(), readQueue.end());
+    readQueue.clear();
+    guard.unlock();
+
+    std::vector<std::vector<word_t>> pages(requests.size(), std::vector<word_t>(PAGE_SIZE));
+    std::vector<bool> read(requests.size(), false);
+    for (uint64_t i = 0; i < requests.size(); i++) {
+        read[i] = readPage(fd, pages[i].data(), requests[i].slot);
+    }
+
+    guard.lock();
+    for (uint64_t i = 0; i < requests.size(); i++) {
+        uint64_t page = requests[i].page;
+        auto stored = generations.find(page);
+        if (!read[i] || stored == generations.end() || stored->second != requests[i].generation ||
+            pending.count(page) != 0 || readCache.count(page) != 0) {
+            continue;
+        }
+        readCache[page].swap(pages[i]);
+        readCacheOrder.push_back(page);
+        // the order may still name pages restored since, so it is bounded rather than the cache
+        while (readCacheOrder.size() > SWAP_READAHEAD_CACHE) {
+            readCache.erase(readCacheOrder.front());
+            readCacheOrder.pop_front();
+        }
+    }
+}
+
+/**
+* Function appends a word to an encoding as a zigzag varint
+*@param word  the word
+*@param out  where the word goes, advanced past it
+*@param end  the end of the encoding buffer
+*@return false if the word does not fit
+*/
+static bool putWord(word_t word, uint8_t*& out, const uint8_t* end) {
+    int64_t value = word;
+    uint64_t zigzag = ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+    do {
+        if (out == end) {
+            return false;
+        }
+        uint8_t low = zigzag & 0x7f;
+        zigzag >>= 7;
+        *out++ = low | (zigzag != 0 ? 0x80 : 0);
+    } while (zigzag != 0);
+    return true;
+}
+
+static word_t getWord(const uint8_t*& in) {
+    uint64_t zigzag = 0;
+    uint8_t byte;
+    uint64_t shift = 0;
+    do {
+        byte = *in++;
+        zigzag |= (uint64_t) (byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return (word_t) (int64_t) ((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+}
+
+/**
+* Function encodes a page: a token byte starts every run, its low 7 bits give the length of the run
+* minus 1 and its high bit tells a run of one repeated word (stored once) from a run of literal words
+*@param data  the page
+*@param out  MAX_ENCODED_BYTES bytes for the encoding
+*@return the length of the encoding, 0 if it would be longer than MAX_ENCODED_BYTES
+*/
+static uint64_t encodePage(const word_t* data, uint8_t* out) {
+    uint8_t* start = out;
+    const uint8_t* end = out + MAX_ENCODED_BYTES;
+    uint64_t i = 0;
+    while (i < PAGE_SIZE) {
+        uint64_t run = 1;
+        while (i + run < PAGE_SIZE && run < MAX_RUN && data[i + run] == data[i]) {
+            run++;
+        }
+        if (run >= 2) {
+            if (out == end) {
+                return 0;
+            }
+            *out++ = 0x80 | (uint8_t) (run - 1);
+            if (!putWord(data[i], out, end)) {
+                return 0;
+            }
+            i += run;
+            continue;
+        }
+        // literals up to the next pair of equal words
+        while (i + run < PAGE_SIZE && run < MAX_RUN &&
+               (i + run + 1 == PAGE_SIZE || data[i + run] != data[i + run + 1])) {
+            run++;
+        }
+        if (out == end) {
+            return 0;
+        }
+        *out++ = (uint8_t) (run - 1);
+        for (uint64_t k = 0; k < run; k++) {
+            if (!putWord(data[i + k], out, end)) {
+                return 0;
+            }
+        }
+        i += run;
+    }
+    return out - start;
+}
+
+static void decodePage(const uint8_t* in, word_t* data) {
+    uint64_t i = 0;
+    while (i < PAGE_SIZE) {
+        uint8_t token = *in++;
+        uint64_t run = (token & 0x7f) + 1;
+        if (token & 0x80) {
+            word_t word = getWord(in);
+            for (uint64_t k = 0; k < run; k++) {
+                data[i + k] = word;
+            }
+        }
+        else {
+            for (uint64_t k = 0; k < run; k++) {
+                data[i + k] = getWord(in);
+            }
+        }
+        i += run;
+    }
+}
+
+CompressedSwapDevice::CompressedSwapDevice(SwapDevice* backing, uint64_t capacityBytes)
+        : backing(backing), capacity(capacityBytes) {
+    clear();
+}
+
+void CompressedSwapDevice::clear() {
+    classes.assign(NUM_CLASSES, SizeClass());
+    index.reset(INITIAL_INDEX_SIZE);
+    coldOrder.clear();
+    usedBytes = 0;
+    incompressiblePages = 0;
+    spilledPages = 0;
+    backing->clear();
+}
+
+uint64_t CompressedSwapDevice::size() {
+    return index.count + backing->size();
+}
+
+bool CompressedSwapDevice::contains(uint64_t page) {
+    return index.find(page) != NO_PAGE || backing->contains(page);
+}
+
+void CompressedSwapDevice::store(uint64_t page, const word_t* data) {
+    discard(page);
+    uint8_t encoded[MAX_ENCODED_BYTES];
+    uint64_t length = encodePage(data, encoded);
+    uint64_t sizeClass = length == 0 ? 0 : (length - 1) / CLASS_BYTES;
+    uint64_t blockBytes = (sizeClass + 1) * CLASS_BYTES;
+    if (length == 0 || blockBytes > capacity) {
+        incompressiblePages++;
+        backing->store(page, data);
+        return;
+    }
+    while (usedBytes + blockBytes > capacity) {
+        spillColdest();
+    }
+    uint64_t block = allocateBlock(sizeClass);
+    memcpy(&classes[sizeClass].blocks[block * blockBytes], encoded, length);
+    uint64_t slot = block * NUM_CLASSES + sizeClass;
+    index.insert(page, slot);
+    usedBytes += blockBytes;
+    touch(page, slot);
+}
+
+bool CompressedSwapDevice::load(uint64_t page, word_t* data) {
+    uint64_t bucket = index.find(page);
+    if (bucket == NO_PAGE) {
+        return backing->load(page, data);
+    }
+    decode(index.slots[bucket], data);
+    touch(page, index.slots[bucket]);
+    return true;
+}
+
+void CompressedSwapDevice::discard(uint64_t page) {
+    uint64_t bucket = index.find(page);
+    if (bucket != NO_PAGE) {
+        releaseBlock(bucket);
+    }
+    backing->discard(page);
+}
+
+void CompressedSwapDevice::discardRange(uint64_t firstPage, uint64_t count) {
+    for (uint64_t page : index.pagesIn(firstPage, count)) {
+        releaseBlock(index.find(page));
+    }
+    backing->discardRange(firstPage, count);
+}
+
+void CompressedSwapDevice::getStats(CompressedSwapStats* stats) const {
+    stats->compressedPages = index.count;
+    stats->compressedBytes = usedBytes;
+    stats->incompressiblePages = incompressiblePages;
+    stats->spilledPages = spilledPages;
+}
+
+/**
+* Function takes a free block of a size class, doubling the blocks of the class if none is left
+*/
+uint64_t CompressedSwapDevice::allocateBlock(uint64_t sizeClass) {
+    SizeClass &blocks = classes[sizeClass];
+    if (blocks.freeBlocks.empty()) {
+        uint64_t count = blocks.stamps.size();
+        uint64_t grown = count == 0 ? 1 : 2 * count;
+        blocks.blocks.resize(grown * (sizeClass + 1) * CLASS_BYTES);
+        blocks.stamps.resize(grown);
+        for (uint64_t block = grown; block > count; block--) {
+            blocks.freeBlocks.push_back(block - 1);
+        }
+    }
+    uint64_t block = blocks.freeBlocks.back();
+    blocks.freeBlocks.pop_back();
+    return block;
+}
+
+/**
+* Function frees the block of a compressed page and drops the page from the index
+*@param bucket  the bucket of the page in the index
+*/
+void CompressedSwapDevice::releaseBlock(uint64_t bucket) {
+    uint64_t slot = index.slots[bucket];
+    uint64_t sizeClass = slot % NUM_CLASSES;
+    classes[sizeClass].freeBlocks.push_back(slot / NUM_CLASSES);
+    usedBytes -= (sizeClass + 1) * CLASS_BYTES;
+    index.erase(bucket);
+}
+
+void CompressedSwapDevice::decode(uint64_t slot, word_t* data) {
+    uint64_t sizeClass = slot % NUM_CLASSES;
+    decodePage(&classes[sizeClass].blocks[slot / NUM_CLASSES * (sizeClass + 1) * CLASS_BYTES], data);
+}
+
+/**
+* Function stamps a compressed page as stored or restored last
+*/
+void CompressedSwapDevice::touch(uint64_t page, uint64_t slot) {
+    classes[slot % NUM_CLASSES].stamps[slot / NUM_CLASSES] = ++stamp;
+    coldOrder.push_back({page, stamp});
+    // restores leave outdated entries behind, drop them once they outnumber the pages
+    if (coldOrder.size() > 2 * index.count + MAX_RUN) {
+        std::deque<ColdEntry> current;
+        for (const ColdEntry &entry : coldOrder) {
+            uint64_t bucket = index.find(entry.page);
+            if (bucket == NO_PAGE) {
+                continue;
+            }
+            uint64_t stored = index.slots[bucket];
+            if (classes[stored % NUM_CLASSES].stamps[stored / NUM_CLASSES] == entry.stamp) {
+                current.push_back(entry);
+            }
+        }
+        coldOrder.swap(current);
+    }
+}
+
+/**
+* Function moves the compressed page stored or restored the longest ago down to the device below
+*/
+void CompressedSwapDevice::spillColdest() {
+    while (true) {
+        ColdEntry entry = coldOrder.front();
+        coldOrder.pop_front();
+        uint64_t bucket = index.find(entry.page);
+        if (bucket == NO_PAGE) {
+            continue;
+        }
+        uint64_t slot = index.slots[bucket];
+        if (classes[slot % NUM_CLASSES].stamps[slot / NUM_CLASSES] != entry.stamp) {
+            continue;
+        }
+        word_t data[PAGE_SIZE];
+        decode(slot, data);
+        releaseBlock(bucket);
+        backing->store(entry.page, data);
+        spilledPages++;
+        return;
+    }
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include "MemoryConstants.h"
+#include "PhysicalMemory.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// pages the file swap collects before the writer thread flushes them
+#ifndef SWAP_WRITE_BATCH
+#define SWAP_WRITE_BATCH 32
+#endif
+
+// pages following a restored page that the file swap reads ahead
+#ifndef SWAP_READAHEAD
+#define SWAP_READAHEAD 4
+#endif
+
+// pages kept by the file swap after reading them ahead
+#ifndef SWAP_READAHEAD_CACHE
+#define SWAP_READAHEAD_CACHE 64
+#endif
+
+// marks an empty bucket of a swap index
+#define NO_PAGE UINT64_MAX
+
+/**
+* Open addressing map from a swapped out page to its slot in a swap device.
+* Buckets are probed linearly and removals shift the following entries back,
+* so lookups never step over tombstones and nothing is allocated per page.
+*/
+struct SwapIndex {
+    std::vector<uint64_t> pages;
+    std::vector<uint64_t> slots;
+    uint64_t count = 0;
+
+    void reset(uint64_t capacity);
+    uint64_t bucketOf(uint64_t page) const;
+    uint64_t find(uint64_t page) const;
+    void insert(uint64_t page, uint64_t slot);
+    void erase(uint64_t bucket);
+    void grow();
+    std::vector<uint64_t> pagesIn(uint64_t firstPage, uint64_t count) const;
+};
+
+/**
+* Where evicted pages are kept, every page is PAGE_SIZE words.
+* A restored page keeps its stored copy, so evicting it again unmodified needs no write.
+*/
+class SwapDevice {
+public:
+    virtual ~SwapDevice() = default;
+
+    /**
+    * Drops every stored page
+    */
+    virtual void clear() = 0;
+
+    /**
+    * The number of pages stored
+    */
+    virtual uint64_t size() = 0;
+
+    virtual bool contains(uint64_t page) = 0;
+
+    /**
+    * Stores a copy of a page, replacing the copy stored before if there is one
+    */
+    virtual void store(uint64_t page, const word_t* data) = 0;
+
+    /**
+    * Copies a stored page into data, the stored copy is kept
+    *@return false if the page is not stored, data is left untouched then
+    */
+    virtual bool load(uint64_t page, word_t* data) = 0;
+
+    /**
+    * Drops the stored copy of a page, if there is one
+    */
+    virtual void discard(uint64_t page) = 0;
+
+    /**
+    * Drops the stored copies of every page in [firstPage, firstPage + count)
+    */
+    virtual void discardRange(uint64_t firstPage, uint64_t count) = 0;
+};
+
+/**
+* Keeps the pages in fixed size slots of one pool in memory, grown by doubling when it fills
+*/
+class MemorySwapDevice : public SwapDevice {
+public:
+    explicit MemorySwapDevice(uint64_t initialSlots);
+
+    void clear() override;
+    uint64_t size() override;
+    bool contains(uint64_t page) override;
+    void store(uint64_t page, const word_t* data) override;
+    bool load(uint64_t page, word_t* data) override;
+    void discard(uint64_t page) override;
+    void discardRange(uint64_t firstPage, uint64_t count) override;
+
+private:
+    uint64_t initialSlots;
+    std::vector<word_t> pool;
+    std::vector<uint64_t> freeSlots;
+    SwapIndex index;
+
+    uint64_t allocateSlot();
+};
+
+/**
+* Keeps the pages in fixed size slots of a file on disk.
+* Stores are written behind by a background thread in batches of SWAP_WRITE_BATCH,
+* and restoring a page makes the thread read the next SWAP_READAHEAD stored pages ahead.
+* A page whose write fails is kept in memory and written again with the next batch.
+*/
+class FileSwapDevice : public SwapDevice {
+public:
+    ~FileSwapDevice() override;
+
+    /**
+    * Creates (or truncates) the swap file
+    *@return nullptr if the file could not be opened
+    */
+    static std::unique_ptr<FileSwapDevice> open(const char* path);
+
+    void clear() override;
+    uint64_t size() override;
+    bool contains(uint64_t page) override;
+    void store(uint64_t page, const word_t* data) override;
+    bool load(uint64_t page, word_t* data) override;
+    void discard(uint64_t page) override;
+    void discardRange(uint64_t firstPage, uint64_t count) override;
+
+private:
+    /**
+    * A stored page whose write to the file has not completed, its data stays here until it did
+    */
+    struct PendingWrite {
+        uint64_t page;
+        uint64_t slot;
+        std::vector<word_t> data;
+    };
+
+    /**
+    * A page to read ahead, stamped with its store so a page stored again meanwhile is not mistaken for it
+    */
+    struct ReadAhead {
+        uint64_t page;
+        uint64_t slot;
+        uint64_t generation;
+    };
+
+    int fd;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::thread writer;
+    bool stopping = false;
+
+    SwapIndex index;
+    std::vector<uint64_t> freeSlots;
+    uint64_t nextSlot = 0;
+    uint64_t generation = 0;
+    std::unordered_map<uint64_t, uint64_t> generations;
+
+    std::unordered_map<uint64_t, std::shared_ptr<PendingWrite>> pending;
+    std::deque<std::shared_ptr<PendingWrite>> writeQueue;
+    // writes that failed, still pending and tried again with the next batch
+    std::vector<std::shared_ptr<PendingWrite>> failedWrites;
+    std::deque<ReadAhead> readQueue;
+    std::unordered_map<uint64_t, std::vector<word_t>> readCache;
+    std::deque<uint64_t> readCacheOrder;
+
+    explicit FileSwapDevice(int fd);
+
+    void run();
+    void writeBatch(std::unique_lock<std::mutex> &guard);
+    void readAhead(std::unique_lock<std::mutex> &guard);
+    void queueReadAhead(uint64_t page);
+    void discardLocked(uint64_t page);
+};
+
+/**
+* Keeps pages compressed in memory in front of another device. A page is encoded as runs of one
+* repeated word and runs of literal words, every word a zigzag varint, so zeroes and small integers
+* take a byte or less. The encodings are kept in blocks of a pool per size class. A page that does
+* not shrink to 3/4 of its size is stored in the device below, and when the blocks would take more
+* than the capacity the pages stored or restored the longest ago are moved down to it.
+*/
+class CompressedSwapDevice : public SwapDevice {
+public:
+    /**
+    *@param backing  the device below, it stays owned by the caller
+    *@param capacityBytes  the most bytes the blocks of the pool may take
+    */
+    CompressedSwapDevice(SwapDevice* backing, uint64_t capacityBytes);
+
+    void clear() override;
+    uint64_t size() override;
+    bool contains(uint64_t page) override;
+    void store(uint64_t page, const word_t* data) override;
+    bool load(uint64_t page, word_t* data) override;
+    void discard(uint64_t page) override;
+    void discardRange(uint64_t firstPage, uint64_t count) override;
+
+    void getStats(CompressedSwapStats* stats) const;
+
+private:
+    /**
+    * The blocks of one size, with the stamp of the last store or restore of every block
+    */
+    struct SizeClass {
+        std::vector<uint8_t> blocks;
+        std::vector<uint64_t> stamps;
+        std::vector<uint64_t> freeBlocks;
+    };
+
+    /**
+    * A page in the order of its stores and restores, outdated once the page is stamped again
+    */
+    struct ColdEntry {
+        uint64_t page;
+        uint64_t stamp;
+    };
+
+    SwapDevice* backing;
+    uint64_t capacity;
+    uint64_t usedBytes = 0;
+    uint64_t stamp = 0;
+    std::vector<SizeClass> classes;
+    // the slot of a page is its block times the number of classes plus its class
+    SwapIndex index;
+    std::deque<ColdEntry> coldOrder;
+    uint64_t incompressiblePages = 0;
+    uint64_t spilledPages = 0;
+
+    uint64_t allocateBlock(uint64_t sizeClass);
+    void releaseBlock(uint64_t bucket);
+    void decode(uint64_t slot, word_t* data);
+    void touch(uint64_t page, uint64_t slot);
+    void spillColdest();
+};
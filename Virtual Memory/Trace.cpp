@@ -0,0 +1,94 @@
+#include "Trace.h"
+
+// records a recorder collects before writing them to its file
+#define TRACE_BUFFER_RECORDS 4096
+
+int writeTrace(const char* path, const std::vector<uint64_t>& records) {
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr) {
+        return 0;
+    }
+    TraceHeader header = {TRACE_MAGIC, TRACE_VERSION, records.size()};
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(records.data(), sizeof(uint64_t), records.size(), file) == records.size();
+    return fclose(file) == 0 && written;
+}
+
+int readTrace(const char* path, std::vector<uint64_t>* records) {
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        return 0;
+    }
+    TraceHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != TRACE_MAGIC ||
+        header.version != TRACE_VERSION) {
+        fclose(file);
+        return 0;
+    }
+    records->resize(header.count);
+    bool read = fread(records->data(), sizeof(uint64_t), header.count, file) == header.count;
+    fclose(file);
+    return read;
+}
+
+TraceRecorder::~TraceRecorder() {
+    close();
+}
+
+bool TraceRecorder::open(const char* path) {
+    close();
+    file = fopen(path, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    // the count is filled in by close
+    TraceHeader header = {TRACE_MAGIC, TRACE_VERSION, 0};
+    failed = fwrite(&header, sizeof(header), 1, file) != 1;
+    count = 0;
+    buffer.clear();
+    buffer.reserve(TRACE_BUFFER_RECORDS);
+    return true;
+}
+
+void TraceRecorder::record(uint64_t virtualAddress, bool write) {
+    std::lock_guard<std::mutex> guard(lock);
+    buffer.push_back(traceRecord(virtualAddress, write));
+    if (buffer.size() == TRACE_BUFFER_RECORDS) {
+        flush();
+    }
+}
+
+void TraceRecorder::recordRange(uint64_t virtualAddress, uint64_t count, bool write) {
+    std::lock_guard<std::mutex> guard(lock);
+    for (uint64_t i = 0; i < count; i++) {
+        buffer.push_back(traceRecord(virtualAddress + i, write));
+        if (buffer.size() == TRACE_BUFFER_RECORDS) {
+            flush();
+        }
+    }
+}
+
+void TraceRecorder::flush() {
+    if (!buffer.empty() && fwrite(buffer.data(), sizeof(uint64_t), buffer.size(), file) != buffer.size()) {
+        failed = true;
+    }
+    count += buffer.size();
+    buffer.clear();
+}
+
+bool TraceRecorder::close() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (file == nullptr) {
+        return true;
+    }
+    flush();
+    TraceHeader header = {TRACE_MAGIC, TRACE_VERSION, count};
+    if (fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1) {
+        failed = true;
+    }
+    if (fclose(file) != 0) {
+        failed = true;
+    }
+    file = nullptr;
+    return !failed;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "MemoryConstants.h"
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+// "VMTR" at the start of every trace file
+#define TRACE_MAGIC 0x52544d56u
+#define TRACE_VERSION 1u
+
+/*
+ * A trace is a sequence of word accesses to the virtual memory. A trace file
+ * starts with a header (magic, version, number of records) followed by one
+ * 64 bit record per access: the virtual address shifted left by one, with the
+ * lowest bit set for a write. Values are not kept, a replay writes the address.
+ */
+struct TraceHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+};
+
+inline uint64_t traceRecord(uint64_t virtualAddress, bool write) {
+    return (virtualAddress << 1) | (write ? 1 : 0);
+}
+
+inline uint64_t traceAddress(uint64_t record) {
+    return record >> 1;
+}
+
+inline bool traceIsWrite(uint64_t record) {
+    return (record & 1) != 0;
+}
+
+/*
+ * Writes a whole trace to a file, created or truncated.
+ *
+ * returns 1 on success.
+ * returns 0 if the file cannot be written.
+ */
+int writeTrace(const char* path, const std::vector<uint64_t>& records);
+
+/*
+ * Reads a whole trace file into records.
+ *
+ * returns 1 on success.
+ * returns 0 if the file cannot be read or is not a trace.
+ */
+int readTrace(const char* path, std::vector<uint64_t>* records);
+
+/**
+* Appends records to a trace file through a buffer, the header is completed when it is closed.
+* Records may come from several threads, they are appended in the order they take the lock.
+*/
+class TraceRecorder {
+public:
+    ~TraceRecorder();
+
+    /**
+    * Creates (or truncates) the trace file
+    *@return false if the file could not be opened
+    */
+    bool open(const char* path);
+
+    void record(uint64_t virtualAddress, bool write);
+
+    /**
+    * Records count consecutive accesses of the same kind, one per word
+    */
+    void recordRange(uint64_t virtualAddress, uint64_t count, bool write);
+
+    /**
+    * Flushes the buffer and writes the number of records into the header
+    *@return false if the file could not be written
+    */
+    bool close();
+
+private:
+    FILE* file = nullptr;
+    std::mutex lock;
+    std::vector<uint64_t> buffer;
+    uint64_t count = 0;
+    bool failed = false;
+
+    void flush();
+};
@@ -1,270 +1,282 @@
 #include "PhysicalMemory.h"
 #include "VirtualMemory.h"
+#include "VirtualMemoryEngine.h"
+#include "MissRatio.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
 
 /**
-* Function gets a frame and clear  all its memory in the physical memory
-*@param currentFrame  the frame we want to clear
+* Backend of the engine that forwards to the PM* functions of the simulated RAM
 */
-void clearTable(uint64_t currentFrame) {
-    
-    for (uint64_t i = 0; i < PAGE_SIZE; i++) {
-        PMwrite(currentFrame * PAGE_SIZE + i, 0);
+struct GlobalPhysicalMemory {
+    void read(uint64_t physicalAddress, word_t* value) {
+        PMread(physicalAddress, value);
     }
-}
-/**
-* Helper Function handle the case the frame is empty in the treeTraverse function
-*@param virtualAddress  a frame that represent the limit of the traverse
-*@param currParent  the parent of the current frame
-*@param currFrame  the frame we check now
-*@param isEmpty  represents if found an empty frame in the traverse
-*@param emptyFrame  the empty frame (if found)
-*@param emptyAddressParent  the parent frame of the empty frame
-*/
-void emptyCase(uint64_t virtualAddress, uint64_t currParent, uint64_t currFrame, bool *isEmpty, uint64_t *emptyFrame,
-               uint64_t *emptyAddressParent) {
-    if (virtualAddress != currFrame) {
-        *emptyFrame = currFrame;
-        *emptyAddressParent = currParent;
-        *isEmpty = true;
+
+    void write(uint64_t physicalAddress, word_t value) {
+        PMwrite(physicalAddress, value);
     }
-}
-/**
-* Helper Function that calculate the Cyclic Distance in the treeTraverse function
-*@param pageSwappedIn  the page we swap in the case no empty memory available
-*@param currAddress  the page we check the distance with
-*@return the distance between the pages
-*/
-uint64_t getCyclicDistance(uint64_t pageSwappedIn, uint64_t currAddress) {
-    uint64_t abs;
-    if (pageSwappedIn > currAddress) {
-        abs = pageSwappedIn - currAddress;
+
+    void readRange(uint64_t physicalAddress, word_t* values, uint64_t count) {
+        PMreadRange(physicalAddress, values, count);
     }
-    else {
-        abs = currAddress - pageSwappedIn;
+
+    void writeRange(uint64_t physicalAddress, const word_t* values, uint64_t count) {
+        PMwriteRange(physicalAddress, values, count);
     }
-    uint64_t cyclicDistance = 0;
-    if ((NUM_PAGES - abs) < abs) {
-        cyclicDistance = NUM_PAGES - abs;
+
+    void fillRange(uint64_t physicalAddress, word_t value, uint64_t count) {
+        PMfillRange(physicalAddress, value, count);
     }
-    else {
-        cyclicDistance = abs;
+
+    void zeroFrame(uint64_t frameIndex) {
+        PMzeroFrame(frameIndex);
     }
-    return cyclicDistance;
-}
-/**
-* Helper Function that check if the distance with current page is more than the maximal Cyclic Distance found in the treeTraverse function
-*@param currParent  the parent of current checked frame
-*@param currFrame  the frame we check in this iteration
-*@param pageSwappedIn  the page we swap in the case no empty memory available
-*@param currAddress  the page we check if hes best page to swap out so far
-*@param maxCyclicDistance  the maximum distance so far
-*@param cyclicParent  the parent of the best frame for the swap
-*@param cyclicFrame  the best frame for the swap
-*@param cyclicPage  best page for the swap
-*/
-void cyclicCase(uint64_t currParent, uint64_t currFrame, uint64_t pageSwappedIn, uint64_t currAddress,
-                uint64_t *maxCyclicDistance, uint64_t *cyclicParent, uint64_t *cyclicFrame, uint64_t *cyclicPage) {
-    uint64_t cyclicDistance = getCyclicDistance(pageSwappedIn, currAddress);
-    if (cyclicDistance > *maxCyclicDistance) {
-        *maxCyclicDistance = cyclicDistance;
-        *cyclicParent = currParent;
-        *cyclicFrame = currFrame;
-        *cyclicPage = currAddress;
+
+    void readFrame(uint64_t frameIndex, word_t* values) {
+        PMreadFrame(frameIndex, values);
     }
-}
+
+    void writeFrame(uint64_t frameIndex, const word_t* values) {
+        PMwriteFrame(frameIndex, values);
+    }
+
+    uint64_t findNonZero(uint64_t frameIndex, uint64_t* mask) {
+        return PMfindNonZero(frameIndex, mask);
+    }
+
+    void evict(uint64_t frameIndex, uint64_t evictedPageIndex) {
+        PMevict(frameIndex, evictedPageIndex);
+    }
+
+    void restore(uint64_t frameIndex, uint64_t restoredPageIndex) {
+        PMrestore(frameIndex, restoredPageIndex);
+    }
+
+    void discard(uint64_t firstPageIndex, uint64_t count) {
+        PMdiscard(firstPageIndex, count);
+    }
+
+    bool isSwapped(uint64_t pageIndex) {
+        return PMisSwapped(pageIndex);
+    }
+};
+
+VirtualMemoryEngine<DefaultGeometry, GlobalPhysicalMemory> engine;
+// the trace being recorded, if any
+std::unique_ptr<TraceRecorder> recorder;
+// the analysis of the page references, if one runs
+std::unique_ptr<MissRatioAnalyzer> analyzer;
+// the swap counters of the physical memory when the counters of VMgetStats were last reset
+EvictionStats statsBase = {0, 0, 0};
+
+#ifdef VM_LATENCY_HISTOGRAM
+StatCounter latencies[VM_LATENCY_BUCKETS];
+
 /**
-* Recursive Function the check for a place for the memory, choose with 3 cases:
-* case 1: found empty frame else case 2
-* case 2: found unused frame else case 3
-* case 3: swap the page with maximum Cyclic distance.
-*@param virtualAddress  the boundry of our search
-*@param currAddress  the current address we're at
-*@param currFrame  the current frame wee check
-*@param currParent  the current frame's parent
-*@param currLevel  our current level in the memory tree
-*@param pageSwappedIn  the page we want to swap in
-*@param isEmpty  boolean if found an empty frame
-*@param emptyFrameAddress  address of empty frame(if found)
-*@param emptyFrameParent  address of empty frame's parent
-*@param maxFrameIndex  the maximum index in the frame
-*@param maxCyclicDistance  the maximum cyclic distance so far
-*@param cyclicFrame  the frame of the maximum cyclic distance page so far
-*@param cyclicPage  the page of the maximum cyclic distance page so far
-*@param cyclicParent  the parent of the frame of the maximum cyclic distance page so far
+* Function runs an operation of the virtual memory and counts its latency in the histogram
+*@param operation  returns the result of the operation
 */
-void treeTraverse(uint64_t virtualAddress, uint64_t currAddress, uint64_t currFrame, uint64_t currParent,
-                  uint64_t currLevel, uint64_t pageSwappedIn,
-                  bool* isEmpty, uint64_t* emptyFrameAddress, uint64_t* emptyFrameParent,
-                  uint64_t* maxFrameIndex,
-                  uint64_t* maxCyclicDistance, uint64_t* cyclicFrame, uint64_t* cyclicPage, uint64_t* cyclicParent) {
-    if (*isEmpty) {
-        return;
+template <class Operation>
+int measureLatency(Operation operation) {
+    auto start = std::chrono::steady_clock::now();
+    int result = operation();
+    uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    uint64_t bucket = 63 - __builtin_clzll(nanoseconds | 1);
+    latencies[bucket < VM_LATENCY_BUCKETS ? bucket : VM_LATENCY_BUCKETS - 1]++;
+    return result;
+}
+#else
+template <class Operation>
+int measureLatency(Operation operation) {
+    return operation();
+}
+#endif
+
+void VMinitialize() {
+    PMinitialize();
+    engine.initialize();
+    VMresetStats();
+}
+
+int VMread(uint64_t virtualAddress, word_t* value) {
+    if (recorder != nullptr) {
+        recorder->record(virtualAddress, false);
     }
-    if (currLevel == TABLES_DEPTH) {
-        cyclicCase(currParent, currFrame, pageSwappedIn, currAddress,
-                   maxCyclicDistance, cyclicParent, cyclicFrame, cyclicPage);
-        return;
+    return measureLatency([&] {
+        return engine.read(virtualAddress, value);
+    });
+}
+
+int VMwrite(uint64_t virtualAddress, word_t value) {
+    if (recorder != nullptr) {
+        recorder->record(virtualAddress, true);
     }
-    word_t value;
-    bool haveKids = false;
-    for (uint64_t i = 0; i < PAGE_SIZE; i++) {
-        PMread(currFrame * PAGE_SIZE + i, &value);
-        if (value != 0) {
-            haveKids = true;
-            if ((uint64_t) value > *maxFrameIndex) {
-                *maxFrameIndex = value;
-            }
-            uint64_t newAddress = (currAddress << OFFSET_WIDTH) + i;
-            uint64_t newParent = currFrame * PAGE_SIZE + i;
-            treeTraverse(virtualAddress, newAddress, value,
-                         newParent, currLevel + 1,
-                         pageSwappedIn, isEmpty, emptyFrameAddress, emptyFrameParent,
-                         maxFrameIndex,
-                         maxCyclicDistance, cyclicFrame, cyclicPage, cyclicParent);
-            if (*isEmpty)
-                return;
-        }
+    return measureLatency([&] {
+        return engine.write(virtualAddress, value);
+    });
+}
+
+int VMreadRange(uint64_t virtualAddress, word_t* buffer, uint64_t count) {
+    if (recorder != nullptr) {
+        recorder->recordRange(virtualAddress, count, false);
     }
-    if (!haveKids) {
-        emptyCase(virtualAddress, currParent, currFrame,
-                  isEmpty, emptyFrameAddress, emptyFrameParent);
+    return measureLatency([&] {
+        return engine.readRange(virtualAddress, buffer, count);
+    });
+}
+
+int VMwriteRange(uint64_t virtualAddress, const word_t* buffer, uint64_t count) {
+    if (recorder != nullptr) {
+        recorder->recordRange(virtualAddress, count, true);
     }
+    return measureLatency([&] {
+        return engine.writeRange(virtualAddress, buffer, count);
+    });
 }
-/**
-* get the frame address with the case found in the traverse
-*@param isEmpty  boolean if found an empty frame
-*@param emptyFrameAddress  address of empty frame(if found)
-*@param emptyFrameParent  address of empty frame's parent
-*@param maxFrameIndex  the maximum index in the frame
-*@param cyclicFrame  the frame of the maximum cyclic distance page
-*@param cyclicPage  the page of the maximum cyclic distance page
-*@param cyclicParent  the parent of the frame of the maximum cyclic distance page
-*/
-uint64_t getFrameAddressByCases(bool isEmpty, uint64_t emptyFrameAddress, uint64_t emptyFrameParent,
-                                uint64_t maxFrameIndex, uint64_t cyclicParent, uint64_t cyclicFrame,
-                                uint64_t cyclicPage) {
-    //case 1: A frame containing an empty table
-    if (isEmpty) {
-        PMwrite(emptyFrameParent, 0);
-        return emptyFrameAddress;
+
+int VMmemset(uint64_t virtualAddress, word_t value, uint64_t count) {
+    if (recorder != nullptr) {
+        recorder->recordRange(virtualAddress, count, true);
     }
+    return measureLatency([&] {
+        return engine.memset(virtualAddress, value, count);
+    });
+}
 
-    //case 2: An unused frame
-    if (maxFrameIndex + 1 < NUM_FRAMES) {
-        clearTable(maxFrameIndex + 1);
-        return maxFrameIndex + 1;
+int VMcopy(uint64_t dstAddress, uint64_t srcAddress, uint64_t count) {
+    if (recorder != nullptr) {
+        recorder->recordRange(srcAddress, count, false);
+        recorder->recordRange(dstAddress, count, true);
     }
+    return measureLatency([&] {
+        return engine.copy(dstAddress, srcAddress, count);
+    });
+}
 
-    //case 3: If all frames are already used
-    PMevict(cyclicFrame, cyclicPage);
-    clearTable(cyclicFrame);
-    PMwrite(cyclicParent, 0);
-    return cyclicFrame;
+void VMgetTLBStats(TLBStats* stats) {
+    engine.getTLBStats(stats);
 }
-/**
-* Helper method to initialize the variables for the traverse on the memory tree
 
-*@param virtualAddress  the boundry of our search
-*@param pageSwappedIn  the page we want to swap in
-*/
-uint64_t getNewFrameAddress(uint64_t virtualAddress, uint64_t pageSwappedIn) {
-    uint64_t currParent = 0;
-    uint64_t currLevel = 0;
-    uint64_t currAddress = 0;
-    uint64_t currFrame = 0;
-
-    //empty case
-    bool isEmpty = false;
-    uint64_t emptyFrameAddress = 0;
-    uint64_t emptyFrameParent = 0;
-
-    //unused frame
-    uint64_t maxFrameIndex = 0;
-
-    //all frames are already used
-    uint64_t maxCyclicDistance = 0;
-    uint64_t cyclicParent = 0;
-    uint64_t cyclicFrame = 0;
-    uint64_t cyclicPage = 0;
-
-    treeTraverse(virtualAddress, currAddress, currFrame, currParent,
-                 currLevel, pageSwappedIn,
-                 &isEmpty, &emptyFrameAddress, &emptyFrameParent,
-                 &maxFrameIndex,
-                 &maxCyclicDistance, &cyclicFrame,
-                 &cyclicPage, &cyclicParent);
-
-    return getFrameAddressByCases(isEmpty, emptyFrameAddress, emptyFrameParent, maxFrameIndex, cyclicParent,
-                                  cyclicFrame, cyclicPage);
+void VMresetTLBStats() {
+    engine.resetTLBStats();
 }
-/**
-*Function get a virtual address and find a corresponding frame to read from  or write into
-*@param virtualAddress the address in our virtual memory.
-*/
-uint64_t getFrames(uint64_t virtualAddress) {
-    word_t value = 0;
-    uint64_t currAddress = 0;
-    uint64_t page = ((1 << (VIRTUAL_ADDRESS_WIDTH - OFFSET_WIDTH)) - 1) & (virtualAddress >> OFFSET_WIDTH);
-    // we want to calculate rootSize as it won't necessarily equal to OFFSET_WIDTH
-    uint64_t rootSize = VIRTUAL_ADDRESS_WIDTH % OFFSET_WIDTH;
-    if (rootSize == 0) {
-        rootSize = OFFSET_WIDTH;
+
+void VMgetStats(VMStats* stats) {
+    engine.getStats(stats);
+    EvictionStats evictionStats;
+    PMgetEvictionStats(&evictionStats);
+    stats->swapIns = evictionStats.restoredPages - statsBase.restoredPages;
+    stats->swapOuts = evictionStats.dirtyEvictions - statsBase.dirtyEvictions;
+#ifdef VM_LATENCY_HISTOGRAM
+    for (uint64_t i = 0; i < VM_LATENCY_BUCKETS; i++) {
+        stats->latency[i] = latencies[i];
     }
-    for (uint64_t i = 0; i < TABLES_DEPTH; i++) {
-        uint64_t currLevel;
-        if (i == 0) {
-            currLevel = ((1 << rootSize) - 1) & (virtualAddress >> (TABLES_DEPTH * OFFSET_WIDTH));
-        }
-        else {
-            currLevel = ((1 << OFFSET_WIDTH) - 1) & (virtualAddress >> ((TABLES_DEPTH - i) * OFFSET_WIDTH));
-        }
-        PMread(currAddress * PAGE_SIZE + currLevel, &value);
-        if (value == 0) {
-            //getting the address of the new available frame
-            uint64_t newFrameAddress = getNewFrameAddress(currAddress, page);
-            // in case we couldn't get an address for the new frame
-            if (newFrameAddress == 0)
-                return 0;
-            PMwrite(currAddress * PAGE_SIZE + currLevel, (word_t) newFrameAddress);
-            currAddress = newFrameAddress;
-        }
-        else {
-            currAddress = value;
-        }
+#endif
+}
+
+void VMresetStats() {
+    engine.resetStats();
+    PMgetEvictionStats(&statsBase);
+#ifdef VM_LATENCY_HISTOGRAM
+    for (uint64_t i = 0; i < VM_LATENCY_BUCKETS; i++) {
+        latencies[i] = 0;
     }
-    PMrestore(currAddress, page);
-    return currAddress;
+#endif
 }
 
-uint64_t getOffset(uint64_t virtualAddress) {
-    uint64_t mask = (1 << OFFSET_WIDTH) - 1;
-    return virtualAddress & mask;
+void VMsetReplacementPolicy(ReplacementPolicyType type) {
+    engine.setReplacementPolicy(type);
 }
 
-void VMinitialize() {
-    for (uint64_t i = 0; i < PAGE_SIZE; i++) {
-        PMwrite(i, 0);
+void VMsetPrefetch(uint64_t maxWindow) {
+    engine.setPrefetch(maxWindow);
+}
+
+int VMsetReclaimWatermarks(uint64_t low, uint64_t high) {
+    return engine.setReclaimWatermarks(low, high);
+}
+
+int VMmapLargePage(uint64_t virtualAddress) {
+    return engine.mapLargePage(virtualAddress);
+}
+
+int VMsplitLargePage(uint64_t virtualAddress) {
+    return engine.splitLargePage(virtualAddress);
+}
+
+void VMgetPolicyStats(PolicyStats* stats) {
+    engine.getPolicyStats(stats);
+}
+
+void VMresetPolicyStats() {
+    engine.resetPolicyStats();
+}
+
+int VMcreateAddressSpace() {
+    return engine.createAddressSpace();
+}
+
+int VMswitchAddressSpace(int asid) {
+    return asid >= 0 && engine.switchAddressSpace(asid);
+}
+
+int VMgetAddressSpace() {
+    return (int) engine.getAddressSpace();
+}
+
+int VMdestroyAddressSpace(int asid) {
+    return asid >= 0 && engine.destroyAddressSpace(asid);
+}
+
+int VMrecordTrace(const char* path) {
+    int closed = recorder == nullptr || recorder->close();
+    recorder.reset();
+    if (path == nullptr) {
+        return closed;
     }
+    std::unique_ptr<TraceRecorder> opened(new TraceRecorder());
+    if (!opened->open(path)) {
+        return 0;
+    }
+    recorder = std::move(opened);
+    return 1;
 }
 
-int VMread(uint64_t virtualAddress, word_t* value) {
-    if (virtualAddress < 0 || virtualAddress >= VIRTUAL_MEMORY_SIZE) {
+int VMstartAnalysis(double samplingRate, uint64_t window) {
+    if (!(samplingRate > 0 && samplingRate <= 1)) {
         return 0;
     }
-    uint64_t offset = getOffset(virtualAddress);
-    uint64_t frames = getFrames(virtualAddress);
-    uint64_t physicalAddress = (frames << OFFSET_WIDTH) + offset;
-    PMread(physicalAddress, value);
+    std::unique_ptr<MissRatioAnalyzer> started(new MissRatioAnalyzer(samplingRate, window));
+    engine.setAnalyzer(started.get());
+    analyzer = std::move(started);
     return 1;
 }
 
-int VMwrite(uint64_t virtualAddress, word_t value) {
-    if (virtualAddress < 0 || virtualAddress >= VIRTUAL_MEMORY_SIZE) {
+void VMstopAnalysis() {
+    engine.setAnalyzer(nullptr);
+    analyzer.reset();
+}
+
+int VMgetMissRatioCurve(double* ratios, uint64_t maxFrames) {
+    if (analyzer == nullptr) {
         return 0;
     }
-    uint64_t offset = getOffset(virtualAddress);
-    uint64_t frames = getFrames(virtualAddress);
-    uint64_t physicalAddress = (frames << OFFSET_WIDTH) + offset;
-    PMwrite(physicalAddress, value);
+    std::vector<double> curve;
+    analyzer->getCurve(maxFrames, &curve);
+    std::copy(curve.begin(), curve.end(), ratios);
     return 1;
 }
+
+uint64_t VMgetWorkingSetSizes(uint64_t* sizes, uint64_t count) {
+    if (analyzer == nullptr) {
+        return 0;
+    }
+    std::vector<uint64_t> workingSets;
+    analyzer->getWorkingSet(&workingSets);
+    std::copy(workingSets.begin(), workingSets.begin() + std::min<uint64_t>(count, workingSets.size()), sizes);
+    return workingSets.size();
+}
@@ -3,12 +3,25 @@
 #include "MemoryConstants.h"
 
 /*
- * Initialize the virtual memory.
+ * When built with VM_CONCURRENT, every function below except VMinitialize
+ * may be called from several threads at once. Accesses to resident pages run
+ * in parallel, page faults are handled one at a time. The current address
+ * space is shared by all the threads, and concurrent accesses to the same
+ * word are not ordered. Range functions translate one page at a time, so
+ * they are not atomic as a whole.
+ */
+
+/*
+ * Initialize the virtual memory, with address space 0 as the only (and
+ * current) address space. Must not run concurrently with any other function
+ * of the virtual memory.
  */
 void VMinitialize();
 
 /* Reads a word from the given virtual address
  * and puts its content in *value.
+ * A page that was never written reads as zeroes from a frame shared by all
+ * such pages, it only takes a frame of its own when it is first written.
  *
  * returns 1 on success.
  * returns 0 on failure (if the address cannot be mapped to a physical
@@ -23,3 +36,293 @@ int VMread(uint64_t virtualAddress, word_t* value);
  * address for any reason)
  */
 int VMwrite(uint64_t virtualAddress, word_t value);
+
+/* Reads 'count' consecutive words starting at the given virtual address
+ * into buffer. Every page of the range is translated once.
+ *
+ * returns 1 on success.
+ * returns 0 on failure (if any address of the range cannot be mapped to a
+ * physical address for any reason)
+ */
+int VMreadRange(uint64_t virtualAddress, word_t* buffer, uint64_t count);
+
+/* Writes 'count' consecutive words from buffer starting at the given virtual
+ * address. Every page of the range is translated once.
+ *
+ * returns 1 on success.
+ * returns 0 on failure (if any address of the range cannot be mapped to a
+ * physical address for any reason)
+ */
+int VMwriteRange(uint64_t virtualAddress, const word_t* buffer, uint64_t count);
+
+/* Writes value to 'count' consecutive words starting at the given virtual
+ * address.
+ *
+ * returns 1 on success.
+ * returns 0 on failure (if any address of the range cannot be mapped to a
+ * physical address for any reason)
+ */
+int VMmemset(uint64_t virtualAddress, word_t value, uint64_t count);
+
+/* Copies 'count' words from srcAddress to dstAddress. The ranges may overlap,
+ * the result is as if the source was first copied to a temporary buffer.
+ *
+ * returns 1 on success.
+ * returns 0 on failure (if any address of either range cannot be mapped to a
+ * physical address for any reason)
+ */
+int VMcopy(uint64_t dstAddress, uint64_t srcAddress, uint64_t count);
+
+/*
+ * Hit and miss counters of the translation cache that sits in front of the
+ * page table walk.
+ */
+struct TLBStats {
+    uint64_t hits;
+    uint64_t misses;
+};
+
+/*
+ * Copies the current translation cache counters into *stats.
+ */
+void VMgetTLBStats(TLBStats* stats);
+
+/*
+ * Zeroes the translation cache counters (the cached translations are kept).
+ */
+void VMresetTLBStats();
+
+// number of buckets of the latency histogram, bucket i counts the operations
+// that took [2^i, 2^(i+1)) nanoseconds, the last one everything slower
+#define VM_LATENCY_BUCKETS 32
+
+/*
+ * Counters of the work done by the virtual memory, always kept. Together
+ * they tell whether time goes to walking tables, to finding frames or to
+ * the swap.
+ *   translations      addresses translated (one for every page of a range)
+ *   tlbHits           translations answered by the translation cache
+ *   walks             table walks (one per translation cache miss, two when
+ *                     a concurrent walk finds the page missing)
+ *   levelsWalked      table entries read by the walks
+ *   faults            pages brought into a frame
+ *   emptyTableReuses  frames taken from an empty table
+ *   unusedFrameUses   frames that were unused, never used before or freed
+ *                     by the reclaimer
+ *   evictions         frames taken by evicting a page
+ *   swapIns           faults whose page was read back from the swap
+ *   swapOuts          evictions that wrote the page to the swap
+ *   tableClears       frames zeroed before being linked in as a table or page
+ *   prefetches        pages brought in ahead of their fault (not in faults)
+ *   prefetchHits      prefetched pages accessed before their eviction
+ *   prefetchWasted    prefetched pages evicted without being accessed
+ *   largeMaps         large pages mapped by VMmapLargePage
+ *   largeSplits       large pages split into pages, by VMsplitLargePage or
+ *                     by evicting the large page
+ *   zeroMaps          reads of pages never written that were answered by
+ *                     the shared zero frame (not counting translation cache
+ *                     hits)
+ *   reclaims          pages evicted ahead of demand by the reclaimer (also
+ *                     counted in evictions)
+ *   latency           latency histogram of VMread, VMwrite and the range
+ *                     functions, only filled when built with
+ *                     VM_LATENCY_HISTOGRAM
+ */
+struct VMStats {
+    uint64_t translations;
+    uint64_t tlbHits;
+    uint64_t walks;
+    uint64_t levelsWalked;
+    uint64_t faults;
+    uint64_t emptyTableReuses;
+    uint64_t unusedFrameUses;
+    uint64_t evictions;
+    uint64_t swapIns;
+    uint64_t swapOuts;
+    uint64_t tableClears;
+    uint64_t prefetches;
+    uint64_t prefetchHits;
+    uint64_t prefetchWasted;
+    uint64_t largeMaps;
+    uint64_t largeSplits;
+    uint64_t zeroMaps;
+    uint64_t reclaims;
+    uint64_t latency[VM_LATENCY_BUCKETS];
+};
+
+/*
+ * Copies the counters gathered since VMinitialize or the last VMresetStats
+ * into *stats.
+ */
+void VMgetStats(VMStats* stats);
+
+/*
+ * Zeroes the counters of VMgetStats (the TLB and policy counters are kept).
+ */
+void VMresetStats();
+
+/*
+ * The rules for choosing the page to evict once every frame is in use.
+ * CYCLIC_POLICY evicts the page with the maximal cyclic distance from the
+ * page swapped in, and is the default.
+ */
+enum ReplacementPolicyType {
+    CYCLIC_POLICY,
+    LRU_POLICY,
+    CLOCK_POLICY,
+    ARC_POLICY,
+    RANDOM_POLICY
+};
+
+/*
+ * Page faults (pages brought into a frame) and evictions under the current
+ * replacement policy.
+ */
+struct PolicyStats {
+    uint64_t faults;
+    uint64_t evictions;
+};
+
+/*
+ * Switches the replacement policy. The pages that are resident stay resident
+ * and the policy counters are zeroed.
+ */
+void VMsetReplacementPolicy(ReplacementPolicyType type);
+
+/*
+ * Copies the current replacement policy counters into *stats.
+ */
+void VMgetPolicyStats(PolicyStats* stats);
+
+/*
+ * Zeroes the replacement policy counters.
+ */
+void VMresetPolicyStats();
+
+/*
+ * Creates a new address space with an empty page table. All address spaces
+ * share the RAM and the swap, and a page of any of them may be evicted to
+ * make room for another.
+ *
+ * returns the id of the new address space.
+ * returns -1 on failure (too many address spaces, or no frame for its table)
+ */
+int VMcreateAddressSpace();
+
+/*
+ * Makes VMread/VMwrite (and the range functions) use the given address space.
+ *
+ * returns 1 on success.
+ * returns 0 if there is no address space with this id.
+ */
+int VMswitchAddressSpace(int asid);
+
+/*
+ * returns the id of the current address space.
+ */
+int VMgetAddressSpace();
+
+/*
+ * Releases all the frames and swapped out pages of an address space.
+ *
+ * returns 1 on success.
+ * returns 0 if there is no address space with this id, or it is address
+ * space 0 or the current address space.
+ */
+int VMdestroyAddressSpace(int asid);
+
+/*
+ * Starts recording every word read or written through VMread, VMwrite and
+ * the range functions into a trace file at 'path' (see Trace.h), created or
+ * truncated. A null path stops recording and completes the file. Like
+ * VMinitialize, must not run concurrently with any other function.
+ *
+ * returns 1 on success.
+ * returns 0 if the file cannot be opened or written.
+ */
+int VMrecordTrace(const char* path);
+
+/*
+ * Turns on the prefetcher: a fault that continues a sequential or strided
+ * stream of faults of the current address space also brings in the next
+ * pages of the stream (their tables included), up to maxWindow pages. The
+ * window grows while the stream goes on and shrinks when prefetched pages
+ * are evicted unused. A maxWindow of 0 (the default) turns it off.
+ */
+void VMsetPrefetch(uint64_t maxWindow);
+
+/*
+ * Keeps a pool of unused frames between the low and high watermark, so a
+ * fault mostly takes a frame from the pool instead of evicting a page. Once
+ * an access leaves fewer than 'low' unused frames, the pages the replacement
+ * policy chooses are evicted ahead of demand, RECLAIM_BATCH at a time, until
+ * there are 'high' unused frames. When built with VM_CONCURRENT a background
+ * thread evicts them and the faults and walks waiting for the tables get in
+ * between batches, otherwise the access that drained the pool evicts them
+ * after it is done with its page. A high watermark of 0 (the default) turns
+ * the reclaimer off. Must not run concurrently with itself.
+ *
+ * returns 1 on success.
+ * returns 0 if low is above high or high is not below NUM_FRAMES.
+ */
+int VMsetReclaimWatermarks(uint64_t low, uint64_t high);
+
+/*
+ * Maps the large page (LARGE_PAGE_SIZE aligned words) holding virtualAddress
+ * in the current address space to PAGE_SIZE contiguous frames, so a single
+ * entry of a last level table and a single translation cache entry translate
+ * all of it. The frames are taken from an aligned run holding the fewest
+ * pages, which are evicted. Evicting the large page swaps out every page and
+ * splits it, its pages then fault back in one by one.
+ *
+ * returns 1 on success or if it is mapped as a large page already.
+ * returns 0 if the layout has no large pages or the RAM has no run to take.
+ */
+int VMmapLargePage(uint64_t virtualAddress);
+
+/*
+ * Splits the large page holding virtualAddress in the current address space
+ * into pages under a new last level table, the pages keep their frames.
+ *
+ * returns 1 on success.
+ * returns 0 if the address is not in a large page or no frame is found for
+ * the new table.
+ */
+int VMsplitLargePage(uint64_t virtualAddress);
+
+/*
+ * Starts following the pages translated by the functions above (one
+ * reference per page a range function translates) to find the miss ratio
+ * curve and the working set size, dropping the results of an analysis that
+ * ran before. Only a samplingRate fraction of the pages is followed (SHARDS
+ * sampling), 1 follows them all. A working set sample is taken every
+ * 'window' references, 0 takes none.
+ *
+ * returns 1 on success.
+ * returns 0 if samplingRate is not in (0, 1].
+ */
+int VMstartAnalysis(double samplingRate, uint64_t window);
+
+/*
+ * Stops the analysis and drops its results.
+ */
+void VMstopAnalysis();
+
+/*
+ * Puts in ratios[frames], for every frames in [0, maxFrames], the fraction
+ * of the references since VMstartAnalysis that an LRU memory of that many
+ * frames would have missed. The curve counts page frames only, the frames
+ * taken by tables come on top.
+ *
+ * returns 1 on success.
+ * returns 0 if no analysis runs.
+ */
+int VMgetMissRatioCurve(double* ratios, uint64_t maxFrames);
+
+/*
+ * Copies the working set sizes (distinct pages referenced in a window) of up
+ * to 'count' windows into sizes, oldest first.
+ *
+ * returns the number of full windows so far, which may be more than count.
+ */
+uint64_t VMgetWorkingSetSizes(uint64_t* sizes, uint64_t count);
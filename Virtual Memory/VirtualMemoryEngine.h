@@ -0,0 +1,1623 @@
+#pragma once
+
+#include "MemoryConstants.h"
+#include "VirtualMemory.h"
+#include "MissRatio.h"
+#include "ReplacementPolicy.h"
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+#ifdef VM_CONCURRENT
+#include <condition_variable>
+#include <thread>
+
+/**
+* Busy waiting lock for the short critical sections of a translation cache set
+*/
+class SpinLock {
+public:
+    void lock() {
+        while (locked.exchange(true, std::memory_order_acquire)) {
+            while (locked.load(std::memory_order_relaxed)) {
+            }
+        }
+    }
+
+    void unlock() {
+        locked.store(false, std::memory_order_release);
+    }
+
+private:
+    std::atomic<bool> locked{false};
+};
+
+typedef std::shared_mutex TableLock;
+typedef std::mutex PolicyLock;
+typedef SpinLock SetLock;
+typedef std::atomic<uint64_t> StatCounter;
+typedef std::atomic<uint8_t> FrameFlag;
+
+/**
+* Function clears a flag of a frame
+*@return whether it was set, only one of the threads racing to clear it sees it set
+*/
+inline bool takeFlag(FrameFlag &flag) {
+    return flag.load(std::memory_order_relaxed) != 0 && flag.exchange(0, std::memory_order_relaxed) != 0;
+}
+#else
+/**
+* Stands in for every lock of the engine when it is built for a single thread
+*/
+struct NoLock {
+    void lock() {}
+    void unlock() {}
+    void lock_shared() {}
+    void unlock_shared() {}
+};
+
+typedef NoLock TableLock;
+typedef NoLock PolicyLock;
+typedef NoLock SetLock;
+typedef uint64_t StatCounter;
+typedef uint8_t FrameFlag;
+
+inline bool takeFlag(FrameFlag &flag) {
+    bool set = flag != 0;
+    flag = 0;
+    return set;
+}
+#endif
+
+/**
+* A single cached translation of a virtual page to the frame holding it
+*@param page  the virtual page number
+*@param frame  the frame the page is mapped to
+*@param lastUsed  the tick of the last hit, used to pick the LRU way of a set
+*@param valid  whether the entry holds a translation
+*@param large  whether the entry translates a large page, page is then the large page number
+*              and frame the first frame of its run
+*/
+struct TLBEntry {
+    uint64_t page;
+    uint64_t frame;
+    uint64_t lastUsed;
+    bool valid;
+    bool large;
+};
+
+/**
+* One set of the translation cache with its own lock and counters, on its own cache line
+*@param ways  the entries of the set
+*@param tick  counts the hits and inserts of the set, used to order its ways by last use
+*@param stats  the hits and misses of the pages of the set
+*@param lookups  the same, counted since the engine counters were reset
+*@param lock  guards the set when translations run in parallel
+*/
+struct alignas(64) TLBSet {
+    TLBEntry ways[TLB_WAYS];
+    uint64_t tick;
+    TLBStats stats;
+    TLBStats lookups;
+    SetLock lock;
+};
+
+/**
+* Counters of the engine behind VMStats that are not kept by the translation cache sets,
+* only the walks of resident pages update them in parallel
+*/
+struct EngineCounters {
+    StatCounter walks{0};
+    StatCounter levelsWalked{0};
+    StatCounter faults{0};
+    StatCounter emptyTableReuses{0};
+    StatCounter unusedFrameUses{0};
+    StatCounter evictions{0};
+    StatCounter tableClears{0};
+    StatCounter prefetches{0};
+    StatCounter prefetchHits{0};
+    StatCounter prefetchWasted{0};
+    StatCounter largeMaps{0};
+    StatCounter largeSplits{0};
+    StatCounter zeroMaps{0};
+    StatCounter reclaims{0};
+};
+
+/**
+* The stream of faults of one address space that the prefetcher follows
+*@param lastPage  the last page the stream covered, faulted or prefetched
+*@param stride  the distance between the pages of the stream, 0 before a second fault
+*@param window  the number of pages prefetched on the next fault of the stream
+*/
+struct PrefetchStream {
+    uint64_t lastPage;
+    int64_t stride;
+    uint64_t window;
+};
+
+/**
+* Metadata kept for every frame alongside the tables, so a fault never has to scan the tree
+*@param parent  the physical address of the table entry pointing to the frame
+*@param prefix  the virtual prefix translated by the frame (the page number for a page)
+*@param head  the first frame of the run if the frame holds a page of a large page, 0 otherwise
+*@param children  the number of non-zero entries if the frame holds a table
+*@param asid  the address space the frame belongs to
+*@param level  the level of the frame in the memory tree (tablesDepth for a page)
+* The narrow fields keep the table at 32 bytes a frame, so RAMs of millions of frames stay cheap.
+*/
+struct FrameInfo {
+    uint64_t parent;
+    uint64_t prefix;
+    uint64_t head;
+    uint32_t children;
+    uint16_t asid;
+    uint8_t level;
+};
+
+/**
+* The virtual memory engine: a hierarchical page table over a physical memory.
+* Everything that depends on the address layout is resolved at compile time from Geometry.
+*@param Geometry  a VMGeometry giving the widths of the offset, physical and virtual addresses
+*@param PhysicalMemory  the backend holding the frames, with read/write/readRange/writeRange/
+*                       fillRange/zeroFrame/readFrame/writeFrame/findNonZero/evict/restore/discard/isSwapped
+*                       members that take the same arguments as the PM* functions
+*
+* Every address space has its own root table, all of them share the frames and the swap.
+* Pages are identified across address spaces by asid * numPages + page, so the pages of
+* address space 0 keep their plain numbers.
+*
+* Built with VM_CONCURRENT, the engine may be called from many threads. Translations of resident
+* pages (a cache hit or a walk that finds every entry) run in parallel under a shared lock on the
+* tables, while faults, evictions and changes of address spaces or policy take it exclusively.
+* Without VM_CONCURRENT every lock is a no-op.
+*
+* A large page maps the pageSize pages under one entry of a table of level tablesDepth - 2 to
+* a run of pageSize contiguous (and aligned) frames, the entry holds the first frame of the
+* run with LARGE_ENTRY set. The walk stops at that entry, and the replacement policy sees the
+* whole run as its first page held by its first frame.
+*
+* A page that is neither resident nor swapped out holds zeroes, so a read of it is answered from
+* ZERO_FRAME, a frame that holds zeroes and is never linked into a table nor seen by the policy.
+* The page takes no frame (and no tables) until it is first written, the translation cache may
+* keep its zero mapping meanwhile, but only for reads.
+*
+* With reclaim watermarks set, the engine keeps between the low and high watermark unused frames
+* by evicting pages ahead of demand, RECLAIM_BATCH at a time, so a fault mostly just pops a frame.
+* Built with VM_CONCURRENT a background thread does the evicting, letting the tables lock go
+* between batches, otherwise the access that left the pool below the low watermark does it once
+* it is done with its page.
+*/
+template <class Geometry, class PhysicalMemory>
+class VirtualMemoryEngine {
+public:
+    static constexpr uint64_t PAGE_WORDS = Geometry::pageSize;
+    static constexpr uint64_t DEPTH = Geometry::tablesDepth;
+    static constexpr uint64_t NO_FRAME = UINT64_MAX;
+    static constexpr word_t LARGE_ENTRY = (word_t) 1 << (WORD_WIDTH - 2);
+    // large pages need a table above the last level, a run besides the root, and a free bit in the entries
+    static constexpr bool LARGE_PAGES = DEPTH >= 2 && Geometry::numFrames >= 2 * PAGE_WORDS &&
+                                        Geometry::numFrames <= (uint64_t) LARGE_ENTRY;
+    static constexpr uint64_t ZERO_FRAME = 1;
+    // the zero frame must leave room for the root, a table of every other level and a page
+    static constexpr bool ZERO_PAGE = Geometry::numFrames >= DEPTH + 2;
+
+    // the largest chunk of a page VMcopy stages at a time
+    static constexpr uint64_t COPY_WORDS = PAGE_WORDS < 1024 ? PAGE_WORDS : 1024;
+
+    static_assert(Geometry::virtualAddressWidth - Geometry::offsetWidth + ASID_WIDTH <= 64,
+                  "a page tagged with its address space must fit in uint64_t");
+    static_assert(Geometry::numFrames - 1 <= (uint64_t) std::numeric_limits<word_t>::max(),
+                  "frame indices must fit in a table entry, build with VM_64BIT_WORDS");
+    static_assert(Geometry::offsetWidth < 32 && ASID_WIDTH <= 16, "the frame table fields must fit");
+
+    explicit VirtualMemoryEngine(PhysicalMemory memory = PhysicalMemory())
+            : memory(std::move(memory)), policyType(CYCLIC_POLICY) {}
+
+#ifdef VM_CONCURRENT
+    ~VirtualMemoryEngine() {
+        stopReclaimer();
+    }
+#endif
+
+    /**
+    * Initialize the virtual memory: address space 0 with an empty root table in frame 0 and every other frame unused
+    */
+    void initialize() {
+        std::unique_lock<TableLock> guard(tableLock);
+        tlbFlush();
+        frameTable.assign(Geometry::numFrames, FrameInfo());
+        freeFrames.clear();
+        for (uint64_t frame = Geometry::numFrames - 1; frame > (ZERO_PAGE ? ZERO_FRAME : 0); frame--) {
+            freeFrames.push_back(frame);
+        }
+        emptyTables.clear();
+        residentCount = 0;
+        largeCount = 0;
+        roots.assign(1, 0);
+        streams.assign(1, PrefetchStream());
+        prefetchedFrames.reset(new FrameFlag[Geometry::numFrames]());
+        freeSpaces.clear();
+        currentSpace = 0;
+        setPolicy(createReplacementPolicy(policyType, Geometry::numFrames, Geometry::numPages));
+        clearStats();
+        memory.zeroFrame(0);
+        if (ZERO_PAGE) {
+            memory.zeroFrame(ZERO_FRAME);
+        }
+    }
+
+    /**
+    * Function replaces the replacement policy, the new policy learns the pages that are resident now
+    *@param type  the new replacement policy
+    */
+    void setReplacementPolicy(ReplacementPolicyType type) {
+        std::unique_lock<TableLock> guard(tableLock);
+        policyType = type;
+        std::unique_ptr<ReplacementPolicy> replacement =
+                createReplacementPolicy(type, Geometry::numFrames, Geometry::numPages);
+        for (uint64_t frame = 1; frame < frameTable.size(); frame++) {
+            // the pages of a large page after the first are not known to the policy
+            if (frameTable[frame].level == DEPTH && (frameTable[frame].head == 0 || frameTable[frame].head == frame)) {
+                replacement->pageIn(getTaggedPage(frameTable[frame]), frame);
+            }
+        }
+        setPolicy(std::move(replacement));
+    }
+
+    /**
+    * Function sets how far the prefetcher may run ahead of a stream of faults
+    *@param maxWindow  the most pages a fault may bring in ahead, 0 turns prefetching off
+    */
+    void setPrefetch(uint64_t maxWindow) {
+        std::unique_lock<TableLock> guard(tableLock);
+        prefetchLimit = maxWindow;
+        streams.assign(streams.size(), PrefetchStream());
+    }
+
+    /**
+    * Function sets the watermarks of the pool of unused frames, starting or stopping the
+    * background reclaimer when built with VM_CONCURRENT. Must not run concurrently with itself.
+    *@param low  an access that leaves fewer unused frames than this has pages evicted ahead of demand
+    *@param high  the number of unused frames the pages are evicted up to, 0 turns reclaiming off
+    *@return 1 on success, 0 if low is above high or high is not below the number of frames
+    */
+    int setReclaimWatermarks(uint64_t low, uint64_t high) {
+        if (low > high || high >= Geometry::numFrames) {
+            return 0;
+        }
+        {
+            std::unique_lock<TableLock> guard(tableLock);
+            reclaimLow = low;
+            reclaimHigh = high;
+        }
+#ifdef VM_CONCURRENT
+        if (high == 0) {
+            stopReclaimer();
+        }
+        else if (!reclaimer.joinable()) {
+            reclaimStop = false;
+            reclaimer = std::thread(&VirtualMemoryEngine::runReclaimer, this);
+        }
+#endif
+        return 1;
+    }
+
+    /**
+    * Function sets the analyzer that every translated page is reported to
+    *@param missRatioAnalyzer  the analyzer, owned by the caller, nullptr for none
+    */
+    void setAnalyzer(MissRatioAnalyzer* missRatioAnalyzer) {
+        std::unique_lock<TableLock> guard(tableLock);
+        analyzer = missRatioAnalyzer;
+    }
+
+    void getPolicyStats(PolicyStats* stats) const {
+        std::shared_lock<TableLock> guard(tableLock);
+        *stats = policyStats;
+    }
+
+    void resetPolicyStats() {
+        std::unique_lock<TableLock> guard(tableLock);
+        policyStats = PolicyStats();
+    }
+
+    /**
+    * Function creates an address space with an empty root table, the root may cost an eviction
+    *@return the id of the new address space, -1 if there are too many or no frame was found for the root
+    */
+    int createAddressSpace() {
+        std::unique_lock<TableLock> guard(tableLock);
+        uint64_t asid;
+        if (!freeSpaces.empty()) {
+            asid = freeSpaces.back();
+        }
+        else if (roots.size() < MAX_ADDRESS_SPACES) {
+            asid = roots.size();
+        }
+        else {
+            return -1;
+        }
+        // frame 0 is never an empty table, so no table is excluded from case 1
+        uint64_t root = getFrameAddressByCases(0, asid * Geometry::numPages);
+        if (root == 0) {
+            return -1;
+        }
+        if (asid == roots.size()) {
+            roots.push_back(root);
+            streams.push_back(PrefetchStream());
+        }
+        else {
+            freeSpaces.pop_back();
+            roots[asid] = root;
+            streams[asid] = PrefetchStream();
+        }
+        frameTable[root] = FrameInfo();
+        frameTable[root].asid = asid;
+        return (int) asid;
+    }
+
+    /**
+    * Function makes the given address space the one read and written by the virtual addresses
+    *@return 1 on success, 0 if there is no such address space
+    */
+    int switchAddressSpace(uint64_t asid) {
+        std::unique_lock<TableLock> guard(tableLock);
+        if (!isAddressSpace(asid)) {
+            return 0;
+        }
+        currentSpace = asid;
+        return 1;
+    }
+
+    uint64_t getAddressSpace() const {
+        std::shared_lock<TableLock> guard(tableLock);
+        return currentSpace;
+    }
+
+    /**
+    * Function releases every frame of an address space and drops its pages from the swap
+    *@return 1 on success, 0 if there is no such address space or it is address space 0 or the current one
+    */
+    int destroyAddressSpace(uint64_t asid) {
+        std::unique_lock<TableLock> guard(tableLock);
+        if (!isAddressSpace(asid) || asid == 0 || asid == currentSpace) {
+            return 0;
+        }
+        std::vector<uint64_t> frames(1, roots[asid]);
+        while (!frames.empty()) {
+            uint64_t frame = frames.back();
+            frames.pop_back();
+            FrameInfo &info = frameTable[frame];
+            if (info.level == DEPTH) {
+                residentCount--;
+                policy->pageOut(getTaggedPage(info), frame);
+                tlbInvalidate(getTaggedPage(info));
+            }
+            else if (info.children == 0 && info.level != 0) {
+                emptyTables.erase(getTableOrder(info));
+            }
+            else {
+                for (word_t value : readChildren(frame)) {
+                    if (value & LARGE_ENTRY) {
+                        releaseRun(value & ~LARGE_ENTRY);
+                    }
+                    else {
+                        frames.push_back(value);
+                    }
+                }
+            }
+            info = FrameInfo();
+            prefetchedFrames[frame] = 0;
+            freeFrames.push_back(frame);
+        }
+        memory.discard(asid * Geometry::numPages, Geometry::numPages);
+        roots[asid] = NO_FRAME;
+        freeSpaces.push_back(asid);
+        return 1;
+    }
+
+    /**
+    * Function maps the large page holding a virtual address of the current address space to a
+    * run of frames. Its resident pages are swapped out, an aligned run holding no tables but
+    * empty ones is emptied (the run with the fewest pages), and every page is restored into it.
+    *@return 1 on success or if it is a large page already, 0 if large pages are not supported
+    *        by the geometry or no run could be emptied
+    */
+    int mapLargePage(uint64_t virtualAddress) {
+        std::unique_lock<TableLock> guard(tableLock);
+        if (!LARGE_PAGES || virtualAddress >= Geometry::virtualMemorySize) {
+            return 0;
+        }
+        uint64_t page = Geometry::getPage(virtualAddress) & ~Geometry::offsetMask;
+        uint64_t firstPage = currentSpace * Geometry::numPages + page;
+        // the tables down to the one holding the entry of the large page, as far as they exist
+        std::vector<uint64_t> path(1, roots[currentSpace]);
+        word_t value = 0;
+        while (path.size() < DEPTH - 1) {
+            memory.read(path.back() * PAGE_WORDS + Geometry::tableIndex(virtualAddress, path.size() - 1), &value);
+            if (value == 0) {
+                break;
+            }
+            path.push_back(value);
+        }
+        if (path.size() == DEPTH - 1) {
+            memory.read(path.back() * PAGE_WORDS + Geometry::tableIndex(virtualAddress, DEPTH - 2), &value);
+            if (value & LARGE_ENTRY) {
+                return 1;
+            }
+            if (value != 0) {
+                dropSubtree(value);
+            }
+        }
+        uint64_t head = emptyRun(path);
+        if (head == 0) {
+            return 0;
+        }
+        // the run is detached from every structure, so making the missing tables never takes its frames
+        uint64_t table = path.back();
+        for (uint64_t level = path.size() - 1; level < DEPTH - 2; level++) {
+            uint64_t frame = getFrameAddressByCases(table, firstPage);
+            if (frame == 0) {
+                for (uint64_t i = 0; i < PAGE_WORDS; i++) {
+                    freeFrames.push_back(head + i);
+                }
+                return 0;
+            }
+            linkFrame(table, Geometry::tableIndex(virtualAddress, level), frame, level + 1,
+                      Geometry::pagePrefix(page, level + 1));
+            table = frame;
+        }
+        uint64_t entry = table * PAGE_WORDS + Geometry::tableIndex(virtualAddress, DEPTH - 2);
+        memory.write(entry, (word_t) head | LARGE_ENTRY);
+        if (frameTable[table].children++ == 0 && frameTable[table].level != 0) {
+            emptyTables.erase(getTableOrder(frameTable[table]));
+        }
+        for (uint64_t i = 0; i < PAGE_WORDS; i++) {
+            frameTable[head + i] = FrameInfo{entry, page + i, head, 0, (uint16_t) currentSpace, DEPTH};
+            clearTable(head + i);
+            memory.restore(head + i, firstPage + i);
+        }
+        // the pages were read through the zero frame while they were not resident
+        for (uint64_t i = 0; ZERO_PAGE && i < PAGE_WORDS; i++) {
+            tlbInvalidate(firstPage + i);
+        }
+        residentCount++;
+        largeCount++;
+        counters.largeMaps++;
+        policy->pageIn(firstPage, head);
+        return 1;
+    }
+
+    /**
+    * Function turns the large page holding a virtual address of the current address space back into
+    * pages that stay in their frames, under a new last level table
+    *@return 1 on success, 0 if the address is not in a large page or no frame was found for the table
+    */
+    int splitLargePage(uint64_t virtualAddress) {
+        std::unique_lock<TableLock> guard(tableLock);
+        if (!LARGE_PAGES || virtualAddress >= Geometry::virtualMemorySize) {
+            return 0;
+        }
+        uint64_t page = Geometry::getPage(virtualAddress) & ~Geometry::offsetMask;
+        uint64_t firstPage = currentSpace * Geometry::numPages + page;
+        uint64_t table = roots[currentSpace];
+        word_t value = 0;
+        for (uint64_t level = 0; level < DEPTH - 2; level++) {
+            memory.read(table * PAGE_WORDS + Geometry::tableIndex(virtualAddress, level), &value);
+            if (value == 0) {
+                return 0;
+            }
+            table = value;
+        }
+        uint64_t entry = table * PAGE_WORDS + Geometry::tableIndex(virtualAddress, DEPTH - 2);
+        memory.read(entry, &value);
+        if (!(value & LARGE_ENTRY)) {
+            return 0;
+        }
+        uint64_t frame = getFrameAddressByCases(table, firstPage);
+        if (frame == 0) {
+            return 0;
+        }
+        memory.read(entry, &value);
+        if (!(value & LARGE_ENTRY)) {
+            // the large page was evicted to make room, so its pages are split in the swap already
+            frameTable[frame] = FrameInfo();
+            freeFrames.push_back(frame);
+            return 1;
+        }
+        uint64_t head = value & ~LARGE_ENTRY;
+        tlbInvalidate(firstPage >> Geometry::offsetWidth, true);
+        policy->pageOut(firstPage, head);
+        std::vector<word_t> entries(PAGE_WORDS);
+        for (uint64_t i = 0; i < PAGE_WORDS; i++) {
+            entries[i] = (word_t) (head + i);
+        }
+        memory.writeFrame(frame, entries.data());
+        for (uint64_t i = 0; i < PAGE_WORDS; i++) {
+            frameTable[head + i] = FrameInfo{frame * PAGE_WORDS + i, page + i, 0, 0, (uint16_t) currentSpace, DEPTH};
+            policy->pageIn(firstPage + i, head + i);
+        }
+        frameTable[frame] = FrameInfo{entry, Geometry::pagePrefix(page, DEPTH - 1), 0, PAGE_WORDS, (uint16_t) currentSpace,
+                                      DEPTH - 1};
+        memory.write(entry, (word_t) frame);
+        residentCount += PAGE_WORDS - 1;
+        largeCount--;
+        counters.largeSplits++;
+        return 1;
+    }
+
+    int read(uint64_t virtualAddress, word_t* value) {
+        if (virtualAddress >= Geometry::virtualMemorySize) {
+            return 0;
+        }
+        return accessPage(virtualAddress, false, [&](uint64_t physicalAddress) {
+            memory.read(physicalAddress, value);
+        });
+    }
+
+    int write(uint64_t virtualAddress, word_t value) {
+        if (virtualAddress >= Geometry::virtualMemorySize) {
+            return 0;
+        }
+        return accessPage(virtualAddress, true, [&](uint64_t physicalAddress) {
+            memory.write(physicalAddress, value);
+        });
+    }
+
+    int readRange(uint64_t virtualAddress, word_t* buffer, uint64_t count) {
+        if (!isValidRange(virtualAddress, count)) {
+            return 0;
+        }
+        while (count > 0) {
+            uint64_t segment = getSegmentSize(virtualAddress, count);
+            if (!accessPage(virtualAddress, false, [&](uint64_t physicalAddress) {
+                memory.readRange(physicalAddress, buffer, segment);
+            })) {
+                return 0;
+            }
+            virtualAddress += segment;
+            buffer += segment;
+            count -= segment;
+        }
+        return 1;
+    }
+
+    int writeRange(uint64_t virtualAddress, const word_t* buffer, uint64_t count) {
+        if (!isValidRange(virtualAddress, count)) {
+            return 0;
+        }
+        while (count > 0) {
+            uint64_t segment = getSegmentSize(virtualAddress, count);
+            if (!accessPage(virtualAddress, true, [&](uint64_t physicalAddress) {
+                memory.writeRange(physicalAddress, buffer, segment);
+            })) {
+                return 0;
+            }
+            virtualAddress += segment;
+            buffer += segment;
+            count -= segment;
+        }
+        return 1;
+    }
+
+    int memset(uint64_t virtualAddress, word_t value, uint64_t count) {
+        if (!isValidRange(virtualAddress, count)) {
+            return 0;
+        }
+        while (count > 0) {
+            uint64_t segment = getSegmentSize(virtualAddress, count);
+            if (!accessPage(virtualAddress, true, [&](uint64_t physicalAddress) {
+                memory.fillRange(physicalAddress, value, segment);
+            })) {
+                return 0;
+            }
+            virtualAddress += segment;
+            count -= segment;
+        }
+        return 1;
+    }
+
+    int copy(uint64_t dstAddress, uint64_t srcAddress, uint64_t count) {
+        if (!isValidRange(dstAddress, count) || !isValidRange(srcAddress, count)) {
+            return 0;
+        }
+        // a segment never crosses a page boundary of either range, and is staged in
+        // a buffer since translating the destination may evict the source page
+        word_t buffer[COPY_WORDS];
+        bool backwards = dstAddress > srcAddress && dstAddress < srcAddress + count;
+        while (count > 0) {
+            uint64_t segment;
+            uint64_t src = srcAddress;
+            uint64_t dst = dstAddress;
+            if (backwards) {
+                uint64_t srcLeft = Geometry::getOffset(srcAddress + count - 1) + 1;
+                uint64_t dstLeft = Geometry::getOffset(dstAddress + count - 1) + 1;
+                segment = srcLeft < dstLeft ? srcLeft : dstLeft;
+                segment = segment < count ? segment : count;
+                segment = segment < COPY_WORDS ? segment : COPY_WORDS;
+                src += count - segment;
+                dst += count - segment;
+            }
+            else {
+                segment = getSegmentSize(srcAddress, getSegmentSize(dstAddress, count));
+                segment = segment < COPY_WORDS ? segment : COPY_WORDS;
+                srcAddress += segment;
+                dstAddress += segment;
+            }
+            if (!accessPage(src, false, [&](uint64_t physicalAddress) {
+                memory.readRange(physicalAddress, buffer, segment);
+            })) {
+                return 0;
+            }
+            if (!accessPage(dst, true, [&](uint64_t physicalAddress) {
+                memory.writeRange(physicalAddress, buffer, segment);
+            })) {
+                return 0;
+            }
+            count -= segment;
+        }
+        return 1;
+    }
+
+    void getTLBStats(TLBStats* stats) const {
+        stats->hits = 0;
+        stats->misses = 0;
+        for (TLBSet &set : tlb) {
+            std::lock_guard<SetLock> guard(set.lock);
+            stats->hits += set.stats.hits;
+            stats->misses += set.stats.misses;
+        }
+    }
+
+    void resetTLBStats() {
+        for (TLBSet &set : tlb) {
+            std::lock_guard<SetLock> guard(set.lock);
+            set.stats.hits = 0;
+            set.stats.misses = 0;
+        }
+    }
+
+    /**
+    * Function copies the engine counters into stats, the swap counters and the latency histogram
+    * are left zero as they are kept by the physical memory and the callers
+    */
+    void getStats(VMStats* stats) const {
+        *stats = VMStats();
+        for (TLBSet &set : tlb) {
+            std::lock_guard<SetLock> guard(set.lock);
+            stats->translations += set.lookups.hits + set.lookups.misses;
+            stats->tlbHits += set.lookups.hits;
+        }
+        stats->walks = counters.walks;
+        stats->levelsWalked = counters.levelsWalked;
+        stats->faults = counters.faults;
+        stats->emptyTableReuses = counters.emptyTableReuses;
+        stats->unusedFrameUses = counters.unusedFrameUses;
+        stats->evictions = counters.evictions;
+        stats->tableClears = counters.tableClears;
+        stats->prefetches = counters.prefetches;
+        stats->prefetchHits = counters.prefetchHits;
+        stats->prefetchWasted = counters.prefetchWasted;
+        stats->largeMaps = counters.largeMaps;
+        stats->largeSplits = counters.largeSplits;
+        stats->zeroMaps = counters.zeroMaps;
+        stats->reclaims = counters.reclaims;
+    }
+
+    void resetStats() {
+        std::unique_lock<TableLock> guard(tableLock);
+        clearStats();
+    }
+
+private:
+    PhysicalMemory memory;
+
+    mutable TLBSet tlb[TLB_SETS] = {};
+    EngineCounters counters;
+    // shared by translations of resident pages, exclusive for everything that changes the tables
+    mutable TableLock tableLock;
+
+    std::vector<FrameInfo> frameTable;
+    // frames that hold nothing, those never used are pushed first with the lowest index at the back
+    std::vector<uint64_t> freeFrames;
+    // tables without children, ordered as a depth first traversal would meet them
+    std::map<uint64_t, uint64_t> emptyTables;
+    // pages and large pages in frames, each large page counts once
+    uint64_t residentCount = 0;
+    uint64_t largeCount = 0;
+
+    // the root table of every address space, NO_FRAME for ids that are free
+    std::vector<uint64_t> roots;
+    std::vector<uint64_t> freeSpaces;
+    // the prefetch stream of every address space
+    std::vector<PrefetchStream> streams;
+    uint64_t currentSpace = 0;
+
+    ReplacementPolicyType policyType;
+    std::unique_ptr<ReplacementPolicy> policy;
+    // whether the policy needs to hear about hits, its calls are serialized by policyLock
+    bool policyTracksAccesses = false;
+    PolicyLock policyLock;
+    PolicyStats policyStats = {0, 0};
+
+    // the most pages a fault may prefetch, 0 when prefetching is off
+    uint64_t prefetchLimit = 0;
+    // set while a page is brought in ahead of its fault
+    bool prefetching = false;
+    MissRatioAnalyzer* analyzer = nullptr;
+    // frames holding a prefetched page that was not accessed yet
+    std::unique_ptr<FrameFlag[]> prefetchedFrames;
+
+    // the unused frames below which pages are evicted ahead of demand, and up to which they are
+    uint64_t reclaimLow = 0;
+    uint64_t reclaimHigh = 0;
+    // the last page that faulted, the victims of the reclaimer are chosen as if it was being swapped in
+    uint64_t reclaimHint = 0;
+#ifdef VM_CONCURRENT
+    std::thread reclaimer;
+    // guards the two flags below, never held together with the tables lock
+    std::mutex reclaimMutex;
+    std::condition_variable reclaimWake;
+    bool reclaimPending = false;
+    bool reclaimStop = false;
+#endif
+
+    /**
+    * Function looks up the frame of a page in the translation cache, as a page and then
+    * as part of a large page if there are any
+    *@param page  the virtual page number
+    *@param frame  the frame of the page (if found)
+    *@return true on a hit, false on a miss
+    */
+    bool tlbLookup(uint64_t page, uint64_t *frame) {
+        {
+            TLBSet &set = tlb[page & (TLB_SETS - 1)];
+            std::lock_guard<SetLock> guard(set.lock);
+            if (tlbProbe(set, page, false, frame)) {
+                return true;
+            }
+            if (largeCount == 0) {
+                set.stats.misses++;
+                set.lookups.misses++;
+                return false;
+            }
+        }
+        uint64_t largePage = page >> Geometry::offsetWidth;
+        TLBSet &set = tlb[largePage & (TLB_SETS - 1)];
+        std::lock_guard<SetLock> guard(set.lock);
+        uint64_t head;
+        if (tlbProbe(set, largePage, true, &head)) {
+            *frame = head + (page & Geometry::offsetMask);
+            return true;
+        }
+        set.stats.misses++;
+        set.lookups.misses++;
+        return false;
+    }
+
+    /**
+    * Function looks for an entry in a locked set and counts a hit if it is there
+    *@param set  the set of the entry
+    *@param key  the page, or the large page number
+    *@param large  whether to look for a large page
+    *@param frame  the frame of the entry (if found)
+    */
+    static bool tlbProbe(TLBSet &set, uint64_t key, bool large, uint64_t *frame) {
+        for (uint64_t i = 0; i < TLB_WAYS; i++) {
+            if (set.ways[i].valid && set.ways[i].page == key && set.ways[i].large == large) {
+                set.ways[i].lastUsed = ++set.tick;
+                *frame = set.ways[i].frame;
+                set.stats.hits++;
+                set.lookups.hits++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+    * Function caches the translation of a page, a page of a large page caches the whole large page
+    *@param page  the virtual page number
+    *@param frame  the frame the page is mapped to
+    */
+    void tlbInsert(uint64_t page, uint64_t frame) {
+        if (largeCount != 0 && frameTable[frame].head != 0) {
+            tlbFill(page >> Geometry::offsetWidth, frameTable[frame].head, true);
+        }
+        else {
+            tlbFill(page, frame, false);
+        }
+    }
+
+    /**
+    * Function puts an entry in its set, replacing the least recently used way.
+    * Two threads may walk to the same page, so an entry already cached is only refreshed.
+    *@param key  the page, or the large page number
+    *@param frame  the frame of the page, or the first frame of the large page
+    *@param large  whether the entry is a large page
+    */
+    void tlbFill(uint64_t key, uint64_t frame, bool large) {
+        TLBSet &set = tlb[key & (TLB_SETS - 1)];
+        std::lock_guard<SetLock> guard(set.lock);
+        TLBEntry *victim = nullptr;
+        for (uint64_t i = 0; i < TLB_WAYS; i++) {
+            if (set.ways[i].valid && set.ways[i].page == key && set.ways[i].large == large) {
+                victim = &set.ways[i];
+                break;
+            }
+        }
+        if (victim == nullptr) {
+            victim = &set.ways[0];
+            for (uint64_t i = 0; i < TLB_WAYS; i++) {
+                if (!set.ways[i].valid) {
+                    victim = &set.ways[i];
+                    break;
+                }
+                if (set.ways[i].lastUsed < victim->lastUsed) {
+                    victim = &set.ways[i];
+                }
+            }
+        }
+        victim->page = key;
+        victim->frame = frame;
+        victim->lastUsed = ++set.tick;
+        victim->valid = true;
+        victim->large = large;
+    }
+
+    /**
+    * Function drops the cached translation of a page (or large page) that is no longer mapped
+    *@param key  the page, or the large page number
+    *@param large  whether the entry is a large page
+    */
+    void tlbInvalidate(uint64_t key, bool large = false) {
+        TLBSet &set = tlb[key & (TLB_SETS - 1)];
+        std::lock_guard<SetLock> guard(set.lock);
+        for (uint64_t i = 0; i < TLB_WAYS; i++) {
+            if (set.ways[i].valid && set.ways[i].page == key && set.ways[i].large == large) {
+                set.ways[i].valid = false;
+            }
+        }
+    }
+
+    /**
+    * Function drops every cached translation
+    */
+    void tlbFlush() {
+        for (TLBSet &set : tlb) {
+            std::lock_guard<SetLock> guard(set.lock);
+            for (uint64_t i = 0; i < TLB_WAYS; i++) {
+                set.ways[i].valid = false;
+            }
+        }
+    }
+
+    /**
+    * Function zeroes the counters of getStats
+    */
+    void clearStats() {
+        for (TLBSet &set : tlb) {
+            std::lock_guard<SetLock> guard(set.lock);
+            set.lookups.hits = 0;
+            set.lookups.misses = 0;
+        }
+        counters.walks = 0;
+        counters.levelsWalked = 0;
+        counters.faults = 0;
+        counters.emptyTableReuses = 0;
+        counters.unusedFrameUses = 0;
+        counters.evictions = 0;
+        counters.tableClears = 0;
+        counters.prefetches = 0;
+        counters.prefetchHits = 0;
+        counters.prefetchWasted = 0;
+        counters.largeMaps = 0;
+        counters.largeSplits = 0;
+        counters.zeroMaps = 0;
+        counters.reclaims = 0;
+    }
+
+    /**
+    * Function installs a replacement policy and zeroes its counters
+    *@param replacement  the new policy, already told about the resident pages
+    */
+    void setPolicy(std::unique_ptr<ReplacementPolicy> replacement) {
+        policy = std::move(replacement);
+        policyTracksAccesses = policy->tracksAccesses();
+        policyStats = PolicyStats();
+    }
+
+    /**
+    * Function reports an access to a resident page to the policy, if the policy cares
+    *@param page  the page, tagged with its address space
+    *@param frame  the frame holding the page
+    */
+    void noteAccess(uint64_t page, uint64_t frame) {
+        if (policyTracksAccesses) {
+            // the policy knows a large page by its first page and frame
+            uint64_t head = frameTable[frame].head;
+            if (head != 0) {
+                frame = head;
+                page = getTaggedPage(frameTable[head]);
+            }
+            std::lock_guard<PolicyLock> guard(policyLock);
+            policy->access(page, frame);
+        }
+    }
+
+    /**
+    * Function gets a frame and clear  all its memory in the physical memory
+    *@param currentFrame  the frame we want to clear
+    */
+    void clearTable(uint64_t currentFrame) {
+        counters.tableClears++;
+        memory.zeroFrame(currentFrame);
+    }
+
+    /**
+    * Function reads the non-zero entries of a table, finding them with one scan of the frame
+    *@param frame  the table
+    *@return the entries, in the order of their index
+    */
+    std::vector<word_t> readChildren(uint64_t frame) {
+        std::vector<uint64_t> mask((PAGE_WORDS + 63) / 64);
+        std::vector<word_t> children;
+        children.reserve(memory.findNonZero(frame, mask.data()));
+        for (uint64_t word = 0; word < (PAGE_WORDS + 63) / 64; word++) {
+            for (uint64_t bits = mask[word]; bits != 0; bits &= bits - 1) {
+                word_t value;
+                memory.read(frame * PAGE_WORDS + word * 64 + __builtin_ctzll(bits), &value);
+                children.push_back(value);
+            }
+        }
+        return children;
+    }
+
+    /**
+    * Function gives the position of a table in the depth first order of the trees, one address space after the other.
+    * Two empty tables are never nested, so the first page their subtrees cover orders them.
+    *@param info  the metadata of the table
+    *@return the first page covered by the table, tagged with its address space
+    */
+    static uint64_t getTableOrder(const FrameInfo &info) {
+        return info.asid * Geometry::numPages + (info.prefix << ((DEPTH - info.level) * Geometry::offsetWidth));
+    }
+
+    /**
+    * Function gives the page held by a frame, tagged with its address space
+    *@param info  the metadata of the frame
+    */
+    static uint64_t getTaggedPage(const FrameInfo &info) {
+        return info.asid * Geometry::numPages + info.prefix;
+    }
+
+    bool isAddressSpace(uint64_t asid) const {
+        return asid < roots.size() && roots[asid] != NO_FRAME;
+    }
+
+    /**
+    * Function links a frame into the entry of its parent table and records it in the frame table
+    *@param parentFrame  the table that points to the frame
+    *@param entry  the index of the entry inside the parent table
+    *@param frame  the frame we link
+    *@param level  the level of the frame in the memory tree (tablesDepth for a page)
+    *@param prefix  the virtual prefix translated by the frame (the page number for a page)
+    */
+    void linkFrame(uint64_t parentFrame, uint64_t entry, uint64_t frame, uint64_t level, uint64_t prefix) {
+        memory.write(parentFrame * PAGE_WORDS + entry, (word_t) frame);
+        FrameInfo &info = frameTable[frame];
+        info.parent = parentFrame * PAGE_WORDS + entry;
+        info.prefix = prefix;
+        info.level = level;
+        info.children = 0;
+        info.asid = frameTable[parentFrame].asid;
+        info.head = 0;
+        // root tables are never counted as empty, they are not unlinked
+        if (frameTable[parentFrame].children++ == 0 && frameTable[parentFrame].level != 0) {
+            emptyTables.erase(getTableOrder(frameTable[parentFrame]));
+        }
+        if (level == DEPTH) {
+            residentCount++;
+            policyStats.faults++;
+            if (prefetching) {
+                counters.prefetches++;
+            }
+            else {
+                counters.faults++;
+            }
+            policy->pageIn(getTaggedPage(info), frame);
+        }
+        else {
+            emptyTables[getTableOrder(info)] = frame;
+        }
+    }
+
+    /**
+    * Function removes a frame from its parent table and from the frame table,
+    * its parent becomes an empty table if this was its last child
+    *@param frame  the frame we unlink
+    */
+    void unlinkFrame(uint64_t frame) {
+        FrameInfo &info = frameTable[frame];
+        memory.write(info.parent, 0);
+        if (info.level == DEPTH) {
+            residentCount--;
+            policy->pageOut(getTaggedPage(info), frame);
+        }
+        else {
+            emptyTables.erase(getTableOrder(info));
+        }
+        uint64_t parentFrame = info.parent / PAGE_WORDS;
+        if (--frameTable[parentFrame].children == 0 && frameTable[parentFrame].level != 0) {
+            emptyTables[getTableOrder(frameTable[parentFrame])] = parentFrame;
+        }
+    }
+
+    /**
+    * Function finds the first empty table in depth first order, skipping the table we are filling
+    *@param currFrame  the table we are currently linking into
+    *@param emptyFrame  the empty table (if found)
+    *@return true if an empty table was found
+    */
+    bool findEmptyTable(uint64_t currFrame, uint64_t *emptyFrame) {
+        for (auto &table : emptyTables) {
+            if (table.second != currFrame) {
+                *emptyFrame = table.second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+    * get the frame address for a new table or page, choose with 3 cases:
+    * case 1: found empty table else case 2
+    * case 2: found unused frame else case 3
+    * case 3: swap out the page chosen by the replacement policy.
+    *@param currFrame  the table we are currently linking into, it is never chosen
+    *@param pageSwappedIn  the page we want to swap in, tagged with its address space
+    *@return the frame, 0 if none could be found
+    */
+    uint64_t getFrameAddressByCases(uint64_t currFrame, uint64_t pageSwappedIn) {
+        //case 1: A frame containing an empty table
+        // an empty table maps no pages, so the translation cache holds nothing under it
+        uint64_t emptyFrame;
+        if (findEmptyTable(currFrame, &emptyFrame)) {
+            counters.emptyTableReuses++;
+            unlinkFrame(emptyFrame);
+            return emptyFrame;
+        }
+
+        //case 2: An unused frame
+        if (!freeFrames.empty()) {
+            uint64_t unusedFrame = freeFrames.back();
+            freeFrames.pop_back();
+            counters.unusedFrameUses++;
+            clearTable(unusedFrame);
+            return unusedFrame;
+        }
+
+        //case 3: If all frames are already used
+        if (residentCount == 0) {
+            return 0;
+        }
+        uint64_t victimFrame = policy->selectVictim(pageSwappedIn);
+        if (frameTable[victimFrame].head != 0) {
+            evictRun(victimFrame);
+        }
+        else {
+            evictPage(victimFrame);
+        }
+        clearTable(victimFrame);
+        return victimFrame;
+    }
+
+    /**
+    * Function swaps out the page held by a frame and unlinks it
+    *@param frame  the frame of the page
+    */
+    void evictPage(uint64_t frame) {
+        uint64_t page = getTaggedPage(frameTable[frame]);
+        if (takeFlag(prefetchedFrames[frame])) {
+            // the window of the stream overshot, back off
+            counters.prefetchWasted++;
+            PrefetchStream &stream = streams[frameTable[frame].asid];
+            stream.window = stream.window > 1 ? stream.window / 2 : 1;
+        }
+        memory.evict(frame, page);
+        policyStats.evictions++;
+        counters.evictions++;
+        tlbInvalidate(page);
+        unlinkFrame(frame);
+    }
+
+    /**
+    * Function evicts up to RECLAIM_BATCH pages chosen by the replacement policy into the unused frames
+    *@return whether the unused frames are still below the high watermark and some page is left to evict
+    */
+    bool reclaimBatch() {
+        for (uint64_t i = 0; i < RECLAIM_BATCH; i++) {
+            if (freeFrames.size() >= reclaimHigh || residentCount == 0) {
+                return false;
+            }
+            uint64_t victimFrame = policy->selectVictim(reclaimHint);
+            if (frameTable[victimFrame].head != 0) {
+                evictRun(victimFrame);
+            }
+            else {
+                evictPage(victimFrame);
+            }
+            frameTable[victimFrame] = FrameInfo();
+            freeFrames.push_back(victimFrame);
+            counters.reclaims++;
+        }
+        return freeFrames.size() < reclaimHigh && residentCount != 0;
+    }
+
+    /**
+    * Function refills the unused frames up to the high watermark once they fell below the low one,
+    * called with the tables lock held exclusively and the accessed page done with
+    */
+    void requestReclaim() {
+        if (reclaimHigh == 0 || freeFrames.size() >= reclaimLow) {
+            return;
+        }
+#ifdef VM_CONCURRENT
+        {
+            std::lock_guard<std::mutex> wake(reclaimMutex);
+            reclaimPending = true;
+        }
+        reclaimWake.notify_one();
+#else
+        while (reclaimBatch()) {
+        }
+#endif
+    }
+
+#ifdef VM_CONCURRENT
+    /**
+    * The loop of the background reclaimer: it sleeps until an access asks for frames, then evicts
+    * a batch at a time, letting the faults and walks waiting for the tables in between batches
+    */
+    void runReclaimer() {
+        std::unique_lock<std::mutex> wait(reclaimMutex);
+        while (true) {
+            reclaimWake.wait(wait, [this] {
+                return reclaimStop || reclaimPending;
+            });
+            if (reclaimStop) {
+                return;
+            }
+            reclaimPending = false;
+            wait.unlock();
+            bool more = true;
+            while (more) {
+                std::unique_lock<TableLock> guard(tableLock);
+                more = reclaimBatch();
+            }
+            wait.lock();
+        }
+    }
+
+    /**
+    * Function stops the background reclaimer, if it runs, and waits for it
+    */
+    void stopReclaimer() {
+        if (!reclaimer.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> wake(reclaimMutex);
+            reclaimStop = true;
+        }
+        reclaimWake.notify_one();
+        reclaimer.join();
+    }
+#endif
+
+    /**
+    * Function swaps out every page of a large page, one by one so they come back as pages,
+    * and unlinks it. The first frame of the run is left to the caller, the others become unused.
+    *@param head  the first frame of the run
+    */
+    void evictRun(uint64_t head) {
+        uint64_t firstPage = getTaggedPage(frameTable[head]);
+        for (uint64_t i = 0; i < PAGE_WORDS; i++) {
+            memory.evict(head + i, firstPage + i);
+        }
+        policyStats.evictions++;
+        counters.evictions++;
+        tlbInvalidate(firstPage >> Geometry::offsetWidth, true);
+        unlinkFrame(head);
+        largeCount--;
+        counters.largeSplits++;
+        for (uint64_t i = 1; i < PAGE_WORDS; i++) {
+            frameTable[head + i] = FrameInfo();
+            freeFrames.push_back(head + i);
+        }
+        frameTable[head].head = 0;
+    }
+
+    /**
+    * Function swaps out every page under a frame, then unlinks the tables and frees the frames
+    *@param frame  a table or page
+    */
+    void dropSubtree(uint64_t frame) {
+        if (frameTable[frame].level == DEPTH) {
+            evictPage(frame);
+        }
+        else {
+            for (word_t value : readChildren(frame)) {
+                if (value & LARGE_ENTRY) {
+                    evictRun(value & ~LARGE_ENTRY);
+                    frameTable[value & ~LARGE_ENTRY] = FrameInfo();
+                    freeFrames.push_back(value & ~LARGE_ENTRY);
+                }
+                else {
+                    dropSubtree(value);
+                }
+            }
+            unlinkFrame(frame);
+        }
+        frameTable[frame] = FrameInfo();
+        freeFrames.push_back(frame);
+    }
+
+    bool isRootFrame(uint64_t frame) const {
+        const FrameInfo &info = frameTable[frame];
+        return info.level == 0 && info.asid < roots.size() && roots[info.asid] == frame;
+    }
+
+    /**
+    * Function empties the aligned run of frames with the fewest frames in use, among the runs
+    * holding no roots, no large pages and no table of the given path. Whatever the run holds
+    * is swapped out along with everything under it. The run is left detached: its frames are
+    * neither unused nor linked.
+    *@param path  tables that must stay where they are
+    *@return the first frame of the run, 0 if no run could be emptied
+    */
+    uint64_t emptyRun(const std::vector<uint64_t>& path) {
+        uint64_t best = 0;
+        uint64_t bestUsed = UINT64_MAX;
+        // the first run always holds the root of address space 0
+        for (uint64_t run = PAGE_WORDS; run + PAGE_WORDS <= Geometry::numFrames; run += PAGE_WORDS) {
+            uint64_t used = 0;
+            bool usable = true;
+            for (uint64_t frame = run; frame < run + PAGE_WORDS && usable; frame++) {
+                usable = frameTable[frame].head == 0 && !isRootFrame(frame) &&
+                         std::find(path.begin(), path.end(), frame) == path.end();
+                used += frameTable[frame].level != 0;
+            }
+            if (usable && used < bestUsed) {
+                best = run;
+                bestUsed = used;
+            }
+        }
+        if (best == 0) {
+            return 0;
+        }
+        for (uint64_t frame = best; frame < best + PAGE_WORDS; frame++) {
+            // the frame may have been freed with the subtree of another frame of the run
+            if (frameTable[frame].level != 0) {
+                dropSubtree(frame);
+            }
+        }
+        freeFrames.erase(std::remove_if(freeFrames.begin(), freeFrames.end(), [best](uint64_t frame) {
+            return frame >= best && frame < best + PAGE_WORDS;
+        }), freeFrames.end());
+        for (uint64_t frame = best; frame < best + PAGE_WORDS; frame++) {
+            prefetchedFrames[frame] = 0;
+        }
+        return best;
+    }
+
+    /**
+    * Function forgets a large page of an address space being destroyed and frees its run
+    *@param head  the first frame of the run
+    */
+    void releaseRun(uint64_t head) {
+        residentCount--;
+        largeCount--;
+        policy->pageOut(getTaggedPage(frameTable[head]), head);
+        tlbInvalidate(getTaggedPage(frameTable[head]) >> Geometry::offsetWidth, true);
+        for (uint64_t i = 0; i < PAGE_WORDS; i++) {
+            frameTable[head + i] = FrameInfo();
+            freeFrames.push_back(head + i);
+        }
+    }
+
+    /**
+    * One level of the table walk, unrolled at compile time over the levels
+    *@param virtualAddress  the address we translate
+    *@param page  the page of virtualAddress
+    *@param currAddress  the table of this level
+    *@return the frame of the page, 0 if no frame could be found for it
+    */
+    template <uint64_t Level>
+    uint64_t walk(uint64_t virtualAddress, uint64_t page, uint64_t currAddress) {
+        if constexpr (Level == DEPTH) {
+            counters.levelsWalked += DEPTH;
+            return currAddress;
+        }
+        else {
+            word_t value = 0;
+            uint64_t entry = Geometry::tableIndex(virtualAddress, Level);
+            memory.read(currAddress * PAGE_WORDS + entry, &value);
+            if constexpr (Level + 2 == DEPTH) {
+                if (value & LARGE_ENTRY) {
+                    counters.levelsWalked += Level + 1;
+                    return (value & ~LARGE_ENTRY) + (page & Geometry::offsetMask);
+                }
+            }
+            if (value == 0) {
+                //getting the address of the new available frame
+                uint64_t newFrameAddress = getFrameAddressByCases(currAddress, currentSpace * Geometry::numPages + page);
+                // in case we couldn't get an address for the new frame
+                if (newFrameAddress == 0) {
+                    counters.levelsWalked += Level + 1;
+                    return 0;
+                }
+                linkFrame(currAddress, entry, newFrameAddress, Level + 1, Geometry::pagePrefix(page, Level + 1));
+                currAddress = newFrameAddress;
+            }
+            else {
+                currAddress = value;
+            }
+            return walk<Level + 1>(virtualAddress, page, currAddress);
+        }
+    }
+
+    /**
+    * One level of the read only walk, it stops at the first missing entry instead of filling it
+    *@param virtualAddress  the address we translate
+    *@param currAddress  the table of this level
+    *@return the frame of the page, 0 if the page is not resident
+    */
+    template <uint64_t Level>
+    uint64_t find(uint64_t virtualAddress, uint64_t currAddress) {
+        if constexpr (Level == DEPTH) {
+            counters.levelsWalked += DEPTH;
+            return currAddress;
+        }
+        else {
+            word_t value = 0;
+            memory.read(currAddress * PAGE_WORDS + Geometry::tableIndex(virtualAddress, Level), &value);
+            if (value == 0) {
+                counters.levelsWalked += Level + 1;
+                return 0;
+            }
+            if constexpr (Level + 2 == DEPTH) {
+                if (value & LARGE_ENTRY) {
+                    counters.levelsWalked += Level + 1;
+                    return (value & ~LARGE_ENTRY) + Geometry::getOffset(Geometry::getPage(virtualAddress));
+                }
+            }
+            return find<Level + 1>(virtualAddress, value);
+        }
+    }
+
+    /**
+    * Function finds the frame of a resident page without changing the tables,
+    * so it only needs the tables lock shared
+    *@param virtualAddress  the address in our virtual memory
+    *@param write  true if the page is written, a zero mapping of the translation cache is a miss then
+    *@return the frame of the page, 0 if the page is not resident
+    */
+    uint64_t getResidentFrame(uint64_t virtualAddress, bool write) {
+        uint64_t page = currentSpace * Geometry::numPages + Geometry::getPage(virtualAddress);
+        uint64_t frame;
+        if (tlbLookup(page, &frame)) {
+            if (ZERO_PAGE && frame == ZERO_FRAME) {
+                return write ? 0 : frame;
+            }
+        }
+        else {
+            counters.walks++;
+            frame = find<0>(virtualAddress, roots[currentSpace]);
+            if (frame == 0) {
+                return 0;
+            }
+            notePrefetchUse(frame);
+            tlbInsert(page, frame);
+        }
+        noteAccess(page, frame);
+        return frame;
+    }
+
+    /**
+    * Function counts the first access to a prefetched page
+    *@param frame  the frame of the accessed page
+    */
+    void notePrefetchUse(uint64_t frame) {
+        if (takeFlag(prefetchedFrames[frame])) {
+            counters.prefetchHits++;
+        }
+    }
+
+    /**
+    * Function brings a page of the current address space in ahead of its fault
+    *@param page  the page number
+    *@return false if no frame could be found for it
+    */
+    bool prefetchPage(uint64_t page) {
+        uint64_t faults = policyStats.faults;
+        prefetching = true;
+        uint64_t frame = walk<0>(page << Geometry::offsetWidth, page, roots[currentSpace]);
+        prefetching = false;
+        if (frame == 0) {
+            return false;
+        }
+        // a page that was resident already is left as it is
+        if (policyStats.faults == faults) {
+            return true;
+        }
+        memory.restore(frame, currentSpace * Geometry::numPages + page);
+        prefetchedFrames[frame] = 1;
+        return true;
+    }
+
+    /**
+    * Function follows the fault stream of the current address space: a fault one stride after
+    * the last page of the stream continues it and prefetches the next window of pages, any
+    * other fault starts a new stream. The window doubles while the stream goes on and is
+    * halved whenever a prefetched page is evicted before it was accessed.
+    *@param page  the page that faulted
+    */
+    void prefetchAhead(uint64_t page) {
+        PrefetchStream &stream = streams[currentSpace];
+        int64_t stride = (int64_t) page - (int64_t) stream.lastPage;
+        if (stream.stride == 0 || stride != stream.stride) {
+            stream.lastPage = page;
+            stream.stride = stride;
+            stream.window = 1;
+            return;
+        }
+        uint64_t last = page;
+        for (uint64_t i = 0; i < stream.window; i++) {
+            int64_t next = (int64_t) last + stride;
+            if (next < 0 || next >= (int64_t) Geometry::numPages || !prefetchPage(next)) {
+                break;
+            }
+            last = next;
+        }
+        stream.lastPage = last;
+        stream.window = stream.window * 2 < prefetchLimit ? stream.window * 2 : prefetchLimit;
+    }
+
+    /**
+    * Function walks to the frame of a page, bringing it in if it is not resident
+    *@param virtualAddress  the address in our virtual memory
+    *@return the frame of the page, 0 if no frame could be found for it
+    */
+    uint64_t faultFrame(uint64_t virtualAddress) {
+        uint64_t page = currentSpace * Geometry::numPages + Geometry::getPage(virtualAddress);
+        if (prefetchLimit != 0) {
+            counters.walks++;
+            if (find<0>(virtualAddress, roots[currentSpace]) == 0) {
+                // the pages ahead go first, so bringing them in never evicts the page we return
+                prefetchAhead(Geometry::getPage(virtualAddress));
+            }
+        }
+        uint64_t faults = policyStats.faults;
+        counters.walks++;
+        reclaimHint = page;
+        uint64_t frame = walk<0>(virtualAddress, Geometry::getPage(virtualAddress), roots[currentSpace]);
+        if (frame == 0) {
+            return 0;
+        }
+        // only a page that was just brought in is restored, a resident page may be newer than its swap copy
+        if (policyStats.faults == faults) {
+            notePrefetchUse(frame);
+            noteAccess(page, frame);
+        }
+        else {
+            memory.restore(frame, page);
+        }
+        tlbInsert(page, frame);
+        return frame;
+    }
+
+    /**
+    * Function gives the frame to read a page from, the zero frame if the page is neither resident
+    * nor swapped out, and brings the page in otherwise
+    *@param virtualAddress  the address in our virtual memory
+    *@return the frame of the page, 0 if no frame could be found for it
+    */
+    uint64_t readFrame(uint64_t virtualAddress) {
+        if (ZERO_PAGE) {
+            uint64_t page = currentSpace * Geometry::numPages + Geometry::getPage(virtualAddress);
+            counters.walks++;
+            if (find<0>(virtualAddress, roots[currentSpace]) == 0 && !memory.isSwapped(page)) {
+                counters.zeroMaps++;
+                tlbInsert(page, ZERO_FRAME);
+                return ZERO_FRAME;
+            }
+        }
+        return faultFrame(virtualAddress);
+    }
+
+    /**
+    *Function get a virtual address and find a corresponding frame to read from  or write into
+    *@param virtualAddress the address in our virtual memory.
+    *@param write  true if the page is written, it is brought in even if it was never written before
+    */
+    uint64_t getFrames(uint64_t virtualAddress, bool write) {
+        uint64_t page = currentSpace * Geometry::numPages + Geometry::getPage(virtualAddress);
+        uint64_t cachedFrame;
+        if (tlbLookup(page, &cachedFrame)) {
+            if (!ZERO_PAGE || cachedFrame != ZERO_FRAME) {
+                noteAccess(page, cachedFrame);
+                return cachedFrame;
+            }
+            if (!write) {
+                return cachedFrame;
+            }
+        }
+        return write ? faultFrame(virtualAddress) : readFrame(virtualAddress);
+    }
+
+    /**
+    * Function translates a virtual address of the current address space and runs an operation
+    * on the physical address while the page is guaranteed to stay in its frame.
+    * With VM_CONCURRENT a resident page is reached under the shared lock, and only a fault
+    * retakes the lock exclusively (another thread may have brought the page in meanwhile).
+    *@param virtualAddress  the address in our virtual memory
+    *@param write  true if the operation writes the page, a read may get the zero frame
+    *@param operation  called with the physical address
+    *@return 0 if no frame could be found for the page, 1 otherwise
+    */
+    template <class Operation>
+    int accessPage(uint64_t virtualAddress, bool write, Operation operation) {
+#ifdef VM_CONCURRENT
+        {
+            std::shared_lock<TableLock> guard(tableLock);
+            if (analyzer != nullptr) {
+                analyzer->reference(currentSpace * Geometry::numPages + Geometry::getPage(virtualAddress));
+            }
+            uint64_t frame = getResidentFrame(virtualAddress, write);
+            if (frame != 0) {
+                operation((frame << Geometry::offsetWidth) + Geometry::getOffset(virtualAddress));
+                return 1;
+            }
+        }
+        std::unique_lock<TableLock> guard(tableLock);
+        uint64_t frame = write ? faultFrame(virtualAddress) : readFrame(virtualAddress);
+#else
+        if (analyzer != nullptr) {
+            analyzer->reference(currentSpace * Geometry::numPages + Geometry::getPage(virtualAddress));
+        }
+        uint64_t frame = getFrames(virtualAddress, write);
+#endif
+        if (frame == 0) {
+            return 0;
+        }
+        operation((frame << Geometry::offsetWidth) + Geometry::getOffset(virtualAddress));
+        // with VM_CONCURRENT only the accesses that held the tables exclusively get here
+        requestReclaim();
+        return 1;
+    }
+
+    /**
+    * Function checks that a range of words lies inside the virtual memory
+    *@param virtualAddress  the first address of the range
+    *@param count  the number of words in the range
+    */
+    static bool isValidRange(uint64_t virtualAddress, uint64_t count) {
+        return virtualAddress < Geometry::virtualMemorySize && count <= Geometry::virtualMemorySize - virtualAddress;
+    }
+
+    /**
+    * Function gives the number of words from an address up to the end of its page, at most count
+    *@param virtualAddress  the address we start from
+    *@param count  the number of words left in the range
+    */
+    static uint64_t getSegmentSize(uint64_t virtualAddress, uint64_t count) {
+        uint64_t left = PAGE_WORDS - Geometry::getOffset(virtualAddress);
+        return count < left ? count : left;
+    }
+};
@@ -0,0 +1,111 @@
+/*
+ * Stress and throughput benchmark of concurrent VMread/VMwrite.
+ *
+ * Every thread owns the words whose address is its index modulo the number of
+ * threads, so the threads share pages but never words, and every read is
+ * checked against the last value the thread wrote there.
+ * Two workloads run for 1, 2, 4, ... up to the given number of threads:
+ *   resident  - a few pages that stay in RAM, every access is a translation hit
+ *   faulting  - a span larger than the RAM, accesses keep evicting pages
+ *
+ * Build from this directory:
+ *   g++ -std=c++17 -O2 -DVM_CONCURRENT -I.. ConcurrentBenchmark.cpp ../VirtualMemory.cpp \
+ *       ../PhysicalMemory.cpp ../ReplacementPolicy.cpp ../SwapDevice.cpp ../Trace.cpp ../MissRatio.cpp -lpthread -o concurrent
+ * Usage:
+ *   ./concurrent [maxThreads] [operationsPerThread]
+ */
+#include "VirtualMemory.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+// words of the resident workload, a few pages that always fit in the RAM
+#define RESIDENT_SPAN (PAGE_SIZE * 4)
+// words of the faulting workload, eight times the RAM
+#define FAULTING_SPAN (RAM_SIZE * 8)
+
+std::atomic<uint64_t> failures(0);
+
+/**
+* Function runs the operations of one thread over its words of the span
+*@param thread  the index of the thread
+*@param threads  the number of threads
+*@param span  the number of words the threads share
+*@param operations  the number of reads and writes to run
+*/
+void runThread(uint64_t thread, uint64_t threads, uint64_t span, uint64_t operations) {
+    std::mt19937_64 generator(thread + 1);
+    uint64_t owned = (span - thread + threads - 1) / threads;
+    std::vector<word_t> expected(owned, 0);
+    std::vector<bool> written(owned, false);
+    for (uint64_t i = 0; i < operations; i++) {
+        uint64_t slot = generator() % owned;
+        uint64_t address = slot * threads + thread;
+        if (generator() & 1) {
+            word_t value = (word_t) generator();
+            if (!VMwrite(address, value)) {
+                failures++;
+                continue;
+            }
+            expected[slot] = value;
+            written[slot] = true;
+        }
+        else {
+            word_t value;
+            if (!VMread(address, &value) || (written[slot] && value != expected[slot])) {
+                failures++;
+            }
+        }
+    }
+}
+
+/**
+* Function runs a workload with the given number of threads
+*@return the number of operations per second of all the threads together
+*/
+double runWorkload(uint64_t threads, uint64_t span, uint64_t operations, PolicyStats* stats) {
+    VMinitialize();
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t thread = 0; thread < threads; thread++) {
+        workers.emplace_back(runThread, thread, threads, span, operations);
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    VMgetPolicyStats(stats);
+    return (double) (threads * operations) / elapsed.count();
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t maxThreads = argc > 1 ? strtoull(argv[1], nullptr, 10) : std::thread::hardware_concurrency();
+    uint64_t operations = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1000000;
+    if (maxThreads == 0) {
+        maxThreads = 1;
+    }
+    const char* names[] = {"resident", "faulting"};
+    uint64_t spans[] = {RESIDENT_SPAN, FAULTING_SPAN};
+    printf("%-10s %8s %14s %8s %12s\n", "workload", "threads", "ops/s", "speedup", "faults");
+    for (int workload = 0; workload < 2; workload++) {
+        double single = 0;
+        for (uint64_t threads = 1; threads <= maxThreads; threads *= 2) {
+            PolicyStats stats;
+            double throughput = runWorkload(threads, spans[workload], operations, &stats);
+            if (threads == 1) {
+                single = throughput;
+            }
+            printf("%-10s %8llu %14.0f %8.2f %12llu\n", names[workload], (unsigned long long) threads,
+                   throughput, throughput / single, (unsigned long long) stats.faults);
+        }
+    }
+    if (failures != 0) {
+        printf("FAILED: %llu operations failed or read a wrong value\n", (unsigned long long) failures.load());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * Finds, in one pass over a trace (see Trace.h), the miss ratio an LRU memory
+ * of every size would have on it, to choose PHYSICAL_ADDRESS_WIDTH without
+ * rerunning the workload once per size. Prints:
+ *   the miss ratio curve at every power of two frames, and at NUM_FRAMES
+ *   the working set size (distinct pages per window): min, mean and max
+ *   the miss ratio of every replacement policy of the engine at NUM_FRAMES,
+ *   measured by replaying the trace, next to the curve (the engine also keeps
+ *   its tables in the frames, so it has fewer frames for pages)
+ *
+ * Build from this directory:
+ *   g++ -std=c++17 -O2 -I.. MissRatioCurve.cpp ../VirtualMemory.cpp ../PhysicalMemory.cpp \
+ *       ../ReplacementPolicy.cpp ../SwapDevice.cpp ../Trace.cpp ../MissRatio.cpp -lpthread -o mrc
+ * Usage:
+ *   ./mrc <trace> [samplingRate] [window]
+ * A sampling rate below 1 follows that fraction of the pages (SHARDS), the
+ * window (default 10000) is in references.
+ */
+#include "MissRatio.h"
+#include "Trace.h"
+#include "VirtualMemory.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#define DEFAULT_WINDOW 10000
+
+/**
+* Function replays a trace with a replacement policy
+*@return the fraction of the references that faulted
+*/
+double measureMissRatio(const std::vector<uint64_t>& records, ReplacementPolicyType policy) {
+    VMinitialize();
+    VMsetReplacementPolicy(policy);
+    for (uint64_t record : records) {
+        uint64_t address = traceAddress(record);
+        if (traceIsWrite(record)) {
+            VMwrite(address, (word_t) address);
+        }
+        else {
+            word_t value;
+            VMread(address, &value);
+        }
+    }
+    VMStats stats;
+    VMgetStats(&stats);
+    return records.empty() ? 0 : (double) stats.faults / (double) records.size();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 4) {
+        fprintf(stderr, "usage: %s <trace> [samplingRate] [window]\n", argv[0]);
+        return 1;
+    }
+    double rate = argc > 2 ? atof(argv[2]) : 1.0;
+    uint64_t window = argc > 3 ? strtoull(argv[3], nullptr, 10) : DEFAULT_WINDOW;
+    if (!(rate > 0 && rate <= 1)) {
+        fprintf(stderr, "the sampling rate must be in (0, 1]\n");
+        return 1;
+    }
+    std::vector<uint64_t> records;
+    if (!readTrace(argv[1], &records)) {
+        fprintf(stderr, "cannot read the trace file: %s\n", argv[1]);
+        return 1;
+    }
+
+    MissRatioAnalyzer analyzer(rate, window);
+    for (uint64_t record : records) {
+        analyzer.reference(traceAddress(record) >> OFFSET_WIDTH);
+    }
+    uint64_t maxFrames = std::max<uint64_t>(NUM_FRAMES, NUM_PAGES);
+    std::vector<double> curve;
+    analyzer.getCurve(maxFrames, &curve);
+    printf("%10s %10s\n", "frames", "miss ratio");
+    for (uint64_t frames = 1; frames <= maxFrames; frames *= 2) {
+        printf("%10llu %10.4f%s\n", (unsigned long long) frames, curve[frames], frames == NUM_FRAMES ? "  <- NUM_FRAMES" : "");
+    }
+    if ((NUM_FRAMES & (NUM_FRAMES - 1)) != 0) {
+        printf("%10llu %10.4f  <- NUM_FRAMES\n", (unsigned long long) NUM_FRAMES, curve[NUM_FRAMES]);
+    }
+
+    std::vector<uint64_t> workingSets;
+    analyzer.getWorkingSet(&workingSets);
+    if (!workingSets.empty()) {
+        uint64_t sum = 0;
+        for (uint64_t size : workingSets) {
+            sum += size;
+        }
+        printf("\nworking set over %zu windows of %llu references: min %llu, mean %.1f, max %llu pages\n",
+               workingSets.size(), (unsigned long long) window,
+               (unsigned long long) *std::min_element(workingSets.begin(), workingSets.end()),
+               (double) sum / (double) workingSets.size(),
+               (unsigned long long) *std::max_element(workingSets.begin(), workingSets.end()));
+    }
+
+    printf("\n%-8s %10s %10s\n", "policy", "measured", "LRU curve");
+    const char* names[] = {"cyclic", "lru", "clock", "arc", "random"};
+    ReplacementPolicyType types[] = {CYCLIC_POLICY, LRU_POLICY, CLOCK_POLICY, ARC_POLICY, RANDOM_POLICY};
+    for (int i = 0; i < 5; i++) {
+        printf("%-8s %10.4f %10.4f\n", names[i], measureMissRatio(records, types[i]), curve[NUM_FRAMES]);
+    }
+    return 0;
+}
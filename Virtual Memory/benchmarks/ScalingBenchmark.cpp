@@ -0,0 +1,102 @@
+/*
+ * Shows how the cost of an access changes as the RAM grows by orders of
+ * magnitude under a 48 bit virtual address space. Every geometry runs its own
+ * engine over a SimulatedPhysicalMemory, and reports:
+ *   resident ns/op   random accesses to RESIDENT_PAGES pages that stay in RAM
+ *   faulting ns/op   random accesses to twice as many pages as there are frames
+ *   faults/op        pages brought in per access of the faulting workload
+ *   levels/walk      table entries read per walk of the faulting workload
+ * The frame table, the free frames and the policies all grow with the RAM,
+ * while a translation walks a fixed number of levels, so the cost per access
+ * should stay flat apart from the caches holding less of the tables.
+ *
+ * Build from this directory (64 bit words for table entries of any RAM):
+ *   g++ -std=c++17 -O2 -DVM_64BIT_WORDS -I.. ScalingBenchmark.cpp ../ReplacementPolicy.cpp \
+ *       ../MissRatio.cpp -o scaling
+ * Usage:
+ *   ./scaling [operations]
+ */
+#include "SimulatedPhysicalMemory.h"
+#include "VirtualMemoryEngine.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+
+// accesses of every workload when no count is given
+#define DEFAULT_OPERATIONS 500000
+// pages of the resident workload
+#define RESIDENT_PAGES 64
+// one access in WRITE_RATIO is a write
+#define WRITE_RATIO 4
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+* Function runs random accesses over the first pages of the virtual memory
+*@param engine  an initialized engine
+*@param pages  the number of pages the accesses fall in
+*@param operations  the number of accesses
+*@return the wall time per access in nanoseconds
+*/
+template <class Geometry, class Engine>
+double runAccesses(Engine &engine, uint64_t pages, uint64_t operations) {
+    std::mt19937_64 generator(1);
+    uint64_t failed = 0;
+    Clock::time_point start = Clock::now();
+    for (uint64_t i = 0; i < operations; i++) {
+        uint64_t address = generator() % (pages * Geometry::pageSize);
+        if (generator() % WRITE_RATIO == 0) {
+            failed += !engine.write(address, (word_t) address);
+        }
+        else {
+            word_t value;
+            failed += !engine.read(address, &value);
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+    if (failed != 0) {
+        fprintf(stderr, "%llu accesses failed\n", (unsigned long long) failed);
+    }
+    return elapsed.count() / (double) operations;
+}
+
+/**
+* Function measures both workloads on a new engine of the given geometry and prints its line
+*@param operations  the number of accesses of every workload
+*/
+template <class Geometry>
+void runGeometry(uint64_t operations) {
+    typedef VirtualMemoryEngine<Geometry, SimulatedPhysicalMemory<Geometry>> Engine;
+    std::unique_ptr<Engine> engine(new Engine());
+    engine->initialize();
+    runAccesses<Geometry>(*engine, RESIDENT_PAGES, operations);
+    double resident = runAccesses<Geometry>(*engine, RESIDENT_PAGES, operations);
+
+    engine->initialize();
+    uint64_t pages = 2 * Geometry::numFrames;
+    // every page is written once first, so the accesses run with every frame in use
+    for (uint64_t page = 0; page < pages; page++) {
+        engine->write(page * Geometry::pageSize, (word_t) page);
+    }
+    engine->resetStats();
+    double faulting = runAccesses<Geometry>(*engine, pages, operations);
+    VMStats stats;
+    engine->getStats(&stats);
+    printf("%10llu %6llu %12.1f %12.1f %10.3f %12.2f\n", (unsigned long long) Geometry::numFrames,
+           (unsigned long long) Geometry::tablesDepth, resident, faulting,
+           (double) stats.faults / (double) operations,
+           stats.walks == 0 ? 0.0 : (double) stats.levelsWalked / (double) stats.walks);
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t operations = argc > 1 ? strtoull(argv[1], nullptr, 10) : DEFAULT_OPERATIONS;
+    printf("%10s %6s %12s %12s %10s %12s\n", "frames", "levels", "resident ns", "faulting ns", "faults/op",
+           "levels/walk");
+    runGeometry<VMGeometry<6, 14, 48>>(operations);
+    runGeometry<VMGeometry<6, 18, 48>>(operations);
+    runGeometry<VMGeometry<6, 22, 48>>(operations);
+    runGeometry<VMGeometry<6, 26, 48>>(operations);
+    return 0;
+}
@@ -0,0 +1,288 @@
+/*
+ * Replays traces of word accesses (see Trace.h) against the virtual memory
+ * engine and reports, for every trace:
+ *   ns/op          wall time per access
+ *   faults         pages brought into a frame by their own access
+ *   prefetched     pages brought in ahead by the prefetcher
+ *   evictions      pages swapped out
+ *   PM reads/op    PMread, PMreadRange, PMreadFrame and PMfindNonZero calls
+ *                  per access
+ *   PM writes/op   PMwrite, PMwriteRange, PMfillRange, PMzeroFrame and
+ *                  PMwriteFrame calls per access
+ *   swap ns/op     time spent in PMevict and PMrestore per access
+ * The engine runs over a counting adapter of the PM functions, so the counts
+ * cost nothing in the library itself.
+ *
+ * Build from this directory:
+ *   g++ -std=c++17 -O2 -I.. TraceBenchmark.cpp ../PhysicalMemory.cpp ../ReplacementPolicy.cpp \
+ *       ../SwapDevice.cpp ../Trace.cpp ../MissRatio.cpp -lpthread -o trace
+ * Usage:
+ *   ./trace                                   replays every synthetic pattern,
+ *                                             without and with prefetching
+ *   ./trace generate <pattern> <count> <file> writes a synthetic trace
+ *   ./trace replay <file> [policy] [window]   replays a trace file
+ * Patterns: sequential, strided, random, zipfian.
+ * Policies: cyclic (default), lru, clock, arc, random.
+ * The window is the most pages the prefetcher brings in ahead, 0 (default) is off.
+ * Traces of a running application are recorded with VMrecordTrace.
+ */
+#include "PhysicalMemory.h"
+#include "Trace.h"
+#include "VirtualMemoryEngine.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+
+// accesses of a synthetic trace when no count is given
+#define DEFAULT_TRACE_LENGTH 1000000
+// one access in WRITE_RATIO of a synthetic trace is a write
+#define WRITE_RATIO 4
+// skew of the zipfian pattern
+#define ZIPF_THETA 0.99
+// prefetch window of the synthetic runs with prefetching
+#define PREFETCH_WINDOW 16
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+* Calls of the PM functions made through the counting adapter
+*/
+struct PMCounters {
+    uint64_t reads;
+    uint64_t writes;
+    Clock::duration swapTime;
+};
+
+PMCounters counters;
+
+/**
+* Forwards to the PM* functions like the adapter of the library, counting the calls
+*/
+struct CountingPhysicalMemory {
+    void read(uint64_t physicalAddress, word_t* value) {
+        counters.reads++;
+        PMread(physicalAddress, value);
+    }
+
+    void write(uint64_t physicalAddress, word_t value) {
+        counters.writes++;
+        PMwrite(physicalAddress, value);
+    }
+
+    void readRange(uint64_t physicalAddress, word_t* values, uint64_t count) {
+        counters.reads++;
+        PMreadRange(physicalAddress, values, count);
+    }
+
+    void writeRange(uint64_t physicalAddress, const word_t* values, uint64_t count) {
+        counters.writes++;
+        PMwriteRange(physicalAddress, values, count);
+    }
+
+    void fillRange(uint64_t physicalAddress, word_t value, uint64_t count) {
+        counters.writes++;
+        PMfillRange(physicalAddress, value, count);
+    }
+
+    void zeroFrame(uint64_t frameIndex) {
+        counters.writes++;
+        PMzeroFrame(frameIndex);
+    }
+
+    void readFrame(uint64_t frameIndex, word_t* values) {
+        counters.reads++;
+        PMreadFrame(frameIndex, values);
+    }
+
+    void writeFrame(uint64_t frameIndex, const word_t* values) {
+        counters.writes++;
+        PMwriteFrame(frameIndex, values);
+    }
+
+    uint64_t findNonZero(uint64_t frameIndex, uint64_t* mask) {
+        counters.reads++;
+        return PMfindNonZero(frameIndex, mask);
+    }
+
+    void evict(uint64_t frameIndex, uint64_t evictedPageIndex) {
+        Clock::time_point start = Clock::now();
+        PMevict(frameIndex, evictedPageIndex);
+        counters.swapTime += Clock::now() - start;
+    }
+
+    void restore(uint64_t frameIndex, uint64_t restoredPageIndex) {
+        Clock::time_point start = Clock::now();
+        PMrestore(frameIndex, restoredPageIndex);
+        counters.swapTime += Clock::now() - start;
+    }
+
+    void discard(uint64_t firstPageIndex, uint64_t count) {
+        PMdiscard(firstPageIndex, count);
+    }
+
+    bool isSwapped(uint64_t pageIndex) {
+        return PMisSwapped(pageIndex);
+    }
+};
+
+VirtualMemoryEngine<DefaultGeometry, CountingPhysicalMemory> engine;
+
+/**
+* Function generates a synthetic trace
+*@param pattern  sequential, strided, random or zipfian
+*@param count  the number of accesses
+*@param records  the trace
+*@return false if there is no such pattern
+*/
+bool generateTrace(const std::string &pattern, uint64_t count, std::vector<uint64_t>* records) {
+    std::mt19937_64 generator(1);
+    std::vector<double> zipfCdf;
+    if (pattern == "zipfian") {
+        // cumulative probability of the pages ranked by popularity
+        zipfCdf.resize(NUM_PAGES);
+        double sum = 0;
+        for (uint64_t rank = 0; rank < NUM_PAGES; rank++) {
+            sum += 1.0 / pow((double) (rank + 1), ZIPF_THETA);
+            zipfCdf[rank] = sum;
+        }
+        for (double &probability : zipfCdf) {
+            probability /= sum;
+        }
+    }
+    else if (pattern != "sequential" && pattern != "strided" && pattern != "random") {
+        return false;
+    }
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    records->resize(count);
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t address;
+        if (pattern == "sequential") {
+            address = i % VIRTUAL_MEMORY_SIZE;
+        }
+        else if (pattern == "strided") {
+            // one word of every page, at a different offset each time
+            address = (i * (PAGE_SIZE + 1)) % VIRTUAL_MEMORY_SIZE;
+        }
+        else if (pattern == "random") {
+            address = generator() % VIRTUAL_MEMORY_SIZE;
+        }
+        else {
+            uint64_t rank = std::lower_bound(zipfCdf.begin(), zipfCdf.end(), uniform(generator)) - zipfCdf.begin();
+            rank = rank < NUM_PAGES ? rank : NUM_PAGES - 1;
+            // spread the popular pages over the address space (an odd multiplier permutes the pages)
+            uint64_t page = (rank * 0x9E3779B97F4A7C15ULL) % NUM_PAGES;
+            address = page * PAGE_SIZE + generator() % PAGE_SIZE;
+        }
+        (*records)[i] = traceRecord(address, generator() % WRITE_RATIO == 0);
+    }
+    return true;
+}
+
+/**
+* Function replays a trace on an initialized engine and prints its line of the report
+*@param name  the name of the trace
+*@param records  the trace
+*@param policy  the replacement policy to replay with
+*@param prefetchWindow  the most pages the prefetcher brings in ahead, 0 for no prefetching
+*/
+void replayTrace(const char* name, const std::vector<uint64_t>& records, ReplacementPolicyType policy,
+                 uint64_t prefetchWindow) {
+    PMinitialize();
+    engine.initialize();
+    engine.setReplacementPolicy(policy);
+    engine.setPrefetch(prefetchWindow);
+    counters = PMCounters();
+    uint64_t failed = 0;
+    Clock::time_point start = Clock::now();
+    for (uint64_t record : records) {
+        uint64_t address = traceAddress(record);
+        if (traceIsWrite(record)) {
+            failed += !engine.write(address, (word_t) address);
+        }
+        else {
+            word_t value;
+            failed += !engine.read(address, &value);
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+    std::chrono::duration<double, std::nano> swapTime = counters.swapTime;
+    VMStats stats;
+    engine.getStats(&stats);
+    double operations = records.empty() ? 1 : (double) records.size();
+    printf("%-14s %10zu %8.1f %10llu %10llu %10llu %9.2f %9.2f %8.1f", name, records.size(),
+           elapsed.count() / operations, (unsigned long long) stats.faults, (unsigned long long) stats.prefetches,
+           (unsigned long long) stats.evictions, counters.reads / operations, counters.writes / operations,
+           swapTime.count() / operations);
+    if (failed != 0) {
+        printf("  (%llu failed)", (unsigned long long) failed);
+    }
+    printf("\n");
+}
+
+void printHeader() {
+    printf("%-14s %10s %8s %10s %10s %10s %9s %9s %8s\n", "trace", "ops", "ns/op", "faults", "prefetched",
+           "evictions", "reads/op", "writes/op", "swap ns");
+}
+
+/**
+* Function parses the name of a replacement policy
+*@return false if there is no such policy
+*/
+bool parsePolicy(const char* name, ReplacementPolicyType* policy) {
+    const char* names[] = {"cyclic", "lru", "clock", "arc", "random"};
+    ReplacementPolicyType types[] = {CYCLIC_POLICY, LRU_POLICY, CLOCK_POLICY, ARC_POLICY, RANDOM_POLICY};
+    for (int i = 0; i < 5; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *policy = types[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<uint64_t> records;
+    if (argc == 1) {
+        printHeader();
+        for (const char* pattern : {"sequential", "strided", "random", "zipfian"}) {
+            generateTrace(pattern, DEFAULT_TRACE_LENGTH, &records);
+            replayTrace(pattern, records, CYCLIC_POLICY, 0);
+            std::string prefetched = std::string(pattern) + "+pf";
+            replayTrace(prefetched.c_str(), records, CYCLIC_POLICY, PREFETCH_WINDOW);
+        }
+        return 0;
+    }
+    if (argc == 5 && strcmp(argv[1], "generate") == 0) {
+        if (!generateTrace(argv[2], strtoull(argv[3], nullptr, 10), &records)) {
+            fprintf(stderr, "unknown pattern: %s\n", argv[2]);
+            return 1;
+        }
+        if (!writeTrace(argv[4], records)) {
+            fprintf(stderr, "cannot write the trace file: %s\n", argv[4]);
+            return 1;
+        }
+        return 0;
+    }
+    if (argc >= 3 && argc <= 5 && strcmp(argv[1], "replay") == 0) {
+        ReplacementPolicyType policy = CYCLIC_POLICY;
+        uint64_t prefetchWindow = argc == 5 ? strtoull(argv[4], nullptr, 10) : 0;
+        if (argc >= 4 && !parsePolicy(argv[3], &policy)) {
+            fprintf(stderr, "unknown policy: %s\n", argv[3]);
+            return 1;
+        }
+        if (!readTrace(argv[2], &records)) {
+            fprintf(stderr, "cannot read the trace file: %s\n", argv[2]);
+            return 1;
+        }
+        printHeader();
+        replayTrace(argv[2], records, policy, prefetchWindow);
+        return 0;
+    }
+    fprintf(stderr, "usage: %s [generate <pattern> <count> <file> | replay <file> [policy] [window]]\n", argv[0]);
+    return 1;
+}